@@ -2,36 +2,76 @@
 #define ABSTRACTFITNESS_H
 
 #include "abstractscene.h"
+#include "targetimage.h"
+#include "numatopology.h"
+#include <QVector>
 class QImage;
 
 typedef bool (*SceneComparisonFunction)(const AbstractScene *a, const AbstractScene *b);
 
 class AbstractFitness {
 public:
-  AbstractFitness( const QImage &target ) : m_target( target ) {}
+  AbstractFitness( const TargetImage &target ) : m_target( target ) {}
   virtual ~AbstractFitness() {}
 
   /// renders a scene and calcuates the similarity to the target image
   virtual float getFitness( const QImage &image ) const = 0;
 
+  /// scores several candidates at once, writing one fitness per candidate to results. the default just
+  /// calls getFitness for each, but implementations that stream the target can make one pass over it
+  /// for all of them. results must give the same values as getFitness would
+  virtual void getFitnesses( const QVector< const QImage* > &candidates, QVector< float > &results ) const {
+    results.resize( candidates.size() );
+    for( int i = 0; i < candidates.size(); ++ i )
+      results[i] = getFitness( *candidates[i] );
+  }
+
+  /// how many rows the fitness sums on their own before adding them to the total, band by band from
+  /// the top. 0 means it can only score whole images
+  virtual int bandRows() const { return 0; }
+
+  /// scores rows, an image holding the candidate's rows from top down, writing the partial sum of each
+  /// band in it to partials. top must start a band. adding the partials of every band in order gives
+  /// exactly what getFitness would, however the image was split up
+  virtual void getBandFitnesses( const QImage &rows, int top, float *partials ) const { Q_UNUSED( rows ); Q_UNUSED( top ); Q_UNUSED( partials ); }
+
   /// compares two scenes, and returns true if scene a has better fitness
   /// (basically, we need to know if higher or lower is better)
   static bool sceneHasBetterFitness( const AbstractScene *a, const AbstractScene *b ) {
     return a->fitness() < b->fitness();
   }
-  virtual bool isBetterFitness( float a, float b ) {
+  virtual bool isBetterFitness( float a, float b ) const {
     return a < b;
   }
 
   virtual SceneComparisonFunction sceneHasBetterFitnessMethod() const = 0;
 
-  inline const QImage &target () const { return m_target; }
+  /// the target, or the replica on the calling worker's node if there is one
+  inline const TargetImage &target () const {
+    int node = NumaTopology::threadNode();
+    return node < 0 || node >= m_replicas.size() ? m_target : m_replicas[node];
+  }
+
+  /// copies the target, and whatever else is read on every evaluation, to each NUMA node, so pinned
+  /// workers never read it across the interconnect. does nothing unless the workers are pinned across
+  /// more than one node
+  void replicate() {
+    if ( ! NumaTopology::isPinned() || NumaTopology::nodeCount() < 2 || m_target.isMapped() )
+      return;
+
+    m_replicas.clear();
+    for( int node = 0; node < NumaTopology::nodeCount(); ++ node )
+      NumaTopology::runOnNode( node, [this, node]() { m_replicas << m_target.copy(); replicateTo( node ); } );
+  }
 
 protected:
-  inline QImage &target() { return m_target; }
+  /// makes a node's copy of anything besides the target that's read on every evaluation. it runs on a
+  /// thread bound to the node, for every node in order, so whatever it allocates and fills lands there
+  virtual void replicateTo( int node ) { Q_UNUSED( node ); }
 
 private:
-  QImage m_target;
+  TargetImage m_target;
+  QVector< TargetImage > m_replicas;
 };
 
 #endif // ABSTRACTFITNESS_H
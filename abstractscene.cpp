@@ -16,6 +16,15 @@ AbstractScene::~AbstractScene()
 {
 }
 
+quint64 AbstractScene::combineHash( quint64 hash, quint64 value )
+{
+  // splitmix64's finaliser, which spreads every bit of the input across the output
+  value += hash + Q_UINT64_C( 0x9e3779b97f4a7c15 );
+  value = ( value ^ ( value >> 30 ) ) * Q_UINT64_C( 0xbf58476d1ce4e5b9 );
+  value = ( value ^ ( value >> 27 ) ) * Q_UINT64_C( 0x94d049bb133111eb );
+  return value ^ ( value >> 31 );
+}
+
 void AbstractScene::mutate( int mutationStrength )
 {
   m_fitness = 0.0;
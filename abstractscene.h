@@ -18,8 +18,32 @@ public:
   /// renders the scene to an image
   virtual bool renderTo( QImage &image ) = 0;
 
+  /// renders a cheap approximation of the scene at 1/divisor of its full size, for screening out
+  /// poor candidates before paying for a full render. quality is the scene's own quality setting,
+  /// for scenes that have one. returns false if the scene has no cheaper way to render itself
+  virtual bool renderPreviewTo( QImage &image, int divisor, int quality ) { Q_UNUSED( image ); Q_UNUSED( divisor ); Q_UNUSED( quality ); return false; }
+  /// true if the scene has a cheaper way to render itself, so it's worth screening
+  virtual bool rendersPreviews() const { return false; }
+
+  /// renders just the rows of the scene from top down into band, an image as wide as the scene, so
+  /// that several threads can share one render. only called on scenes that say they render bands,
+  /// and those must always succeed, as a band can't re-roll the whole scene
+  virtual bool renderBandTo( QImage &band, int top ) { Q_UNUSED( band ); Q_UNUSED( top ); return false; }
+  /// true if renderBandTo gives exactly the pixels renderTo would for those rows
+  virtual bool rendersBands() const { return false; }
+
+  /// renders the whole scene shrunk (or stretched) to the size of image, for showing scenes that are
+  /// too big to render whole. returns false if the scene can't
+  virtual bool renderScaledTo( QImage &image ) { Q_UNUSED( image ); return false; }
+
   virtual void randomise() = 0;
 
+  /// a hash of everything that affects how the scene renders, so that identical scenes hash the same
+  /// and can share a fitness. 0 means the scene can't be hashed, and is always evaluated
+  virtual quint64 hash() const { return 0; }
+  /// mixes value into a hash, for implementations of hash(). the order values are mixed in matters
+  static quint64 combineHash( quint64 hash, quint64 value );
+
   /// saves the scene to a non-bitmap file (such as svg, xml)
   virtual void saveToFile( const QString &fn ) = 0;
 
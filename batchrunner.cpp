@@ -0,0 +1,340 @@
+#include "batchrunner.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QImage>
+#include <QImageReader>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include "pluginregistry.h"
+#include "targetimage.h"
+#include "metricsserver.h"
+
+class BatchRunner::SliceRunnable : public QRunnable
+{
+public:
+  SliceRunnable( BatchRunner *runner, Job *job ) : m_runner( runner ), m_job( job ) {}
+  virtual void run() { m_runner->runSlice( m_job ); }
+
+private:
+  BatchRunner *m_runner;
+  Job *m_job;
+};
+
+BatchRunner::BatchRunner( const EvolutionParameters &params, QThreadPool *pool )
+  : m_params( params )
+  , m_pool( pool )
+  , m_report( 0 )
+  , m_metrics( 0 )
+{
+  m_keepResults = false;
+  m_maxActiveJobs = m_pool->maxThreadCount() * 2;
+  m_sliceTime = 50;
+  m_started = false;
+  m_activeJobs = 0;
+  m_runningSlices = 0;
+  m_stopping = false;
+  m_nextId = 1;
+  m_jobCount = 0;
+  m_completed = 0;
+  m_failed = 0;
+}
+
+BatchRunner::~BatchRunner()
+{
+  stop();
+  waitForDone();
+
+  foreach( SceneType *type, m_initialisedTypes )
+    type->shutdown();
+}
+
+bool BatchRunner::addJobs( const QString &path )
+{
+  QFileInfo info( path );
+
+  if ( info.isDir() )
+  {
+    QStringList filters;
+    foreach( QByteArray format, QImageReader::supportedImageFormats() )
+      filters << "*." + QString::fromLatin1( format );
+
+    QDir dir( path );
+    QStringList images( dir.entryList( filters, QDir::Files, QDir::Name ) );
+    foreach( QString image, images )
+      addJob( dir.absoluteFilePath( image ) );
+
+    return ! images.isEmpty();
+  }
+
+  QFile manifest( path );
+  if ( ! manifest.open( QFile::ReadOnly | QFile::Text ) )
+    return false;
+
+  QDir base( info.absoluteDir() );
+  int count = 0;
+  QTextStream in( &manifest );
+  while( ! in.atEnd() )
+  {
+    QString line( in.readLine().trimmed() );
+    if ( line.isEmpty() || line.startsWith( '#' ) )
+      continue;
+
+    addJob( base.absoluteFilePath( line ) );
+    ++ count;
+  }
+
+  return count > 0;
+}
+
+int BatchRunner::addJob( const QString &targetPath, const QString &logPath )
+{
+  return addJob( targetPath, logPath, m_params );
+}
+
+int BatchRunner::addJob( const QString &targetPath, const QString &logPath, const EvolutionParameters &params )
+{
+  Job *job = new Job;
+  job->targetPath = targetPath;
+  job->logPath = logPath.isEmpty() ? targetPath + ".triangles" : logPath;
+  job->params = params;
+  job->engine = 0;
+  job->failed = false;
+  job->cancelled = false;
+
+  QMutexLocker locker( &m_mutex );
+  job->id = m_nextId ++;
+  m_jobs.insert( job->id, job );
+  m_pending.enqueue( job );
+  ++ m_jobCount;
+
+  if ( m_started )
+    dispatch();
+
+  return job->id;
+}
+
+bool BatchRunner::cancel( int id )
+{
+  QMutexLocker locker( &m_mutex );
+
+  Job *job = m_jobs.value( id );
+  if ( ! job )
+    return false;
+
+  if ( m_pending.removeOne( job ) )
+  {
+    // never started, so there's nothing to write out
+    retire( job );
+  } else {
+    // picked up at the start of the job's next slice
+    job->cancelled = true;
+  }
+
+  return true;
+}
+
+void BatchRunner::stop()
+{
+  m_stopping = true;
+}
+
+double BatchRunner::imagesPerHour() const
+{
+  qint64 elapsed = m_timer.isValid() ? m_timer.elapsed() : 0;
+  if ( elapsed <= 0 )
+    return 0;
+
+  return static_cast< double > ( m_completed ) * 3600000.0 / static_cast< double > ( elapsed );
+}
+
+void BatchRunner::start()
+{
+  QMutexLocker locker( &m_mutex );
+
+  if ( m_started )
+    return;
+
+  m_started = true;
+  m_timer.start();
+  dispatch();
+}
+
+void BatchRunner::waitForDone()
+{
+  QMutexLocker locker( &m_mutex );
+
+  while( m_pending.count() || m_activeJobs )
+  {
+    if ( m_stopping.load() )
+    {
+      // jobs that never started are just dropped. running ones get stopped at the start of their next slice
+      m_jobCount -= m_pending.count();
+      foreach( Job *job, m_pending )
+        m_jobs.remove( job->id );
+      qDeleteAll( m_pending );
+      m_pending.clear();
+    }
+
+    if ( ! m_started )
+      break;
+
+    // stop() can't wake us from a signal handler, so look at the flag every now and then
+    m_changed.wait( &m_mutex, 100 );
+  }
+}
+
+void BatchRunner::run()
+{
+  start();
+  waitForDone();
+
+  if ( m_report )
+  {
+    *m_report << "batch: " << m_completed << " of " << m_jobCount << " images completed ("
+              << m_failed << " failed) in " << m_timer.elapsed() / 1000.0 << "s, "
+              << imagesPerHour() << " images/hour" << endl;
+  }
+}
+
+EvolutionSnapshot *BatchRunner::takeSnapshot( int id )
+{
+  // the lock only keeps the engine alive, the slot itself doesn't need it
+  QMutexLocker locker( &m_mutex );
+
+  Job *job = m_jobs.value( id );
+  if ( ! job || ! job->engine )
+    return 0;
+
+  return job->engine->snapshots().take();
+}
+
+QList< BatchRunner::Result > BatchRunner::takeResults()
+{
+  QMutexLocker locker( &m_mutex );
+
+  QList< Result > results( m_results );
+  m_results.clear();
+  return results;
+}
+
+void BatchRunner::dispatch()
+{
+  // admit new jobs, up to the limit on jobs held in memory
+  while( m_pending.count() && m_activeJobs < m_maxActiveJobs )
+  {
+    m_ready.enqueue( m_pending.dequeue() );
+    ++ m_activeJobs;
+  }
+
+  // hand out slices in the order the jobs queued for them, one thread per job at most
+  while( m_ready.count() && m_runningSlices < m_pool->maxThreadCount() )
+  {
+    ++ m_runningSlices;
+    m_pool->start( new SliceRunnable( this, m_ready.dequeue() ) );
+  }
+
+  if ( m_metrics )
+    m_metrics->publishQueue( m_pending.count(), m_ready.count(), m_runningSlices, m_completed, m_failed );
+}
+
+void BatchRunner::runSlice( Job *job )
+{
+  if ( ! job->engine )
+  {
+    // the face detector and renderer setup aren't known to be thread-safe, so only start one job at a time
+    static QMutex initialiseMutex;
+    QMutexLocker initLocker( &initialiseMutex );
+
+    // start the renderer here rather than in the engine, so it stays warm from one job to the next
+    SceneType *type = PluginRegistry::instance().sceneType( job->params.sceneType );
+    if ( type && ! type->isInitialised() && type->initialise( job->params, m_pool->maxThreadCount() ) )
+      m_initialisedTypes.append( type );
+
+    TargetImage target( TargetImage::load( job->targetPath, qint64( job->params.memoryBudgetMB ) * 1024 * 1024 ) );
+    job->engine = new EvolutionEngine( target, job->logPath, job->params );
+    // each job only ever runs on one thread at a time, and the pool is already full of other jobs
+    job->engine->setThreadPool( 0 );
+    job->engine->setPublishBestScene( m_keepResults );
+    if ( m_metrics )
+      job->engine->setMetrics( m_metrics, QString( "%1 %2" ).arg( job->id ).arg( QFileInfo( job->targetPath ).fileName() ) );
+    if ( ! job->engine->initialise() )
+      job->failed = true;
+  }
+
+  bool running = ! job->failed;
+  if ( running && ( m_stopping.load() || job->cancelled.load() ) )
+  {
+    job->engine->stop();
+    running = false;
+  }
+
+  QElapsedTimer slice;
+  slice.start();
+  while( running && slice.elapsed() < m_sliceTime )
+    running = job->engine->step();
+
+  if ( ! running )
+  {
+    // writes out the svgs, so do it before taking the lock
+    job->engine->finish();
+  }
+
+  QMutexLocker locker( &m_mutex );
+  -- m_runningSlices;
+
+  if ( running )
+  {
+    // back of the queue, so everyone else gets a turn first
+    m_ready.enqueue( job );
+  } else {
+    -- m_activeJobs;
+    retire( job );
+  }
+
+  dispatch();
+  m_changed.wakeAll();
+}
+
+void BatchRunner::retire( Job *job )
+{
+  Result result;
+  result.id = job->id;
+  result.targetPath = job->targetPath;
+  result.failed = job->failed;
+  result.error = job->engine ? job->engine->errorString() : QString();
+  result.stopReason = job->engine ? job->engine->stopReason() : EvolutionEngine::StopRequested;
+  result.bestFitness = job->engine ? job->engine->bestFitness() : -1;
+  result.generations = job->engine ? job->engine->totalGenerations() : 0;
+  result.activeTime = job->engine ? job->engine->activeTime() : 0;
+
+  if ( result.failed )
+    ++ m_failed;
+  else if ( job->engine )
+    ++ m_completed;
+  else
+    -- m_jobCount;
+
+  if ( m_keepResults )
+    m_results.append( result );
+
+  if ( m_report )
+  {
+    if ( result.failed )
+    {
+      *m_report << "failed " << result.targetPath << ": " << result.error << endl;
+    } else {
+      *m_report << "done " << result.targetPath << ": fitness " << result.bestFitness
+                << " after " << result.generations << " generations in "
+                << result.activeTime / 1000.0 << "s ("
+                << EvolutionEngine::stopReasonName( result.stopReason ) << ")" << endl;
+    }
+  }
+
+  m_jobs.remove( job->id );
+  delete job->engine;
+  delete job;
+}
@@ -0,0 +1,148 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+#include "evolutionparameters.h"
+#include "evolutionengine.h"
+
+class QThreadPool;
+class SceneType;
+class QTextStream;
+class MetricsServer;
+
+/** Optimises many target images at once on one shared thread pool. Each job is a separate
+    EvolutionEngine. Jobs take turns running short time slices on the pool, round-robin, so a
+    large batch of small images keeps every core busy and no job starves the others.
+
+    Jobs can be added at any time, before or after start(), which is what lets the daemon
+    keep one runner (and its pool and renderer) alive between submissions */
+
+class BatchRunner
+{
+public:
+  /// how a job ended
+  struct Result
+  {
+    int id;
+    QString targetPath;
+    bool failed;
+    /// why the job failed, if it did
+    QString error;
+    EvolutionEngine::StopReason stopReason;
+    float bestFitness;
+    quint64 generations;
+    qint64 activeTime;
+  };
+
+  BatchRunner( const EvolutionParameters &params, QThreadPool *pool );
+  virtual ~BatchRunner();
+
+  /// adds every image in a directory, or every image listed in a manifest file (one path per line,
+  /// relative to the manifest, # for comments). returns false if nothing could be read
+  bool addJobs( const QString &path );
+  /// adds a single target, using the runner's parameters. the logs go to logPath, or <target>.triangles
+  /// if it's empty. returns an id for the job
+  int addJob( const QString &targetPath, const QString &logPath = QString() );
+  /// adds a single target with its own parameters
+  int addJob( const QString &targetPath, const QString &logPath, const EvolutionParameters &params );
+
+  /// stops a single job. it still writes out its results. returns false if there's no such job
+  bool cancel( int id );
+
+  /// maximum number of jobs that are started but not finished. each one holds its pool, target and logs
+  /// in memory, so this bounds memory use. defaults to twice the number of pool threads
+  void setMaxActiveJobs( int count ) { m_maxActiveJobs = count; }
+  /// how long a job runs for before handing its thread to the next job, in milliseconds
+  void setSliceTime( int ms ) { m_sliceTime = ms; }
+  /// if set, a line is written here as each job finishes, plus a summary at the end of run()
+  void setReportStream( QTextStream *stream ) { m_report = stream; }
+  /// if set, results are kept for takeResults(), and engines include their best scene in snapshots
+  void setKeepResults( bool keep ) { m_keepResults = keep; }
+  /// if set, every job publishes its progress here, along with the depth of the queues
+  void setMetricsServer( MetricsServer *metrics ) { m_metrics = metrics; }
+
+  /// starts handing out slices, and returns straight away
+  void start();
+  /// blocks until every job has finished
+  void waitForDone();
+  /// starts, and runs every job until its budget runs out
+  void run();
+  /// stops all running jobs (which still write their results) and drops any that haven't started.
+  /// only sets a flag, so it is safe to call from a signal handler
+  void stop();
+
+  /// takes the latest progress snapshot for a job, or 0 if there isn't a new one
+  EvolutionSnapshot *takeSnapshot( int id );
+  /// takes the results of the jobs that have finished since the last call
+  QList< Result > takeResults();
+
+  int jobCount() const { return m_jobCount; }
+  int completedCount() const { return m_completed; }
+  int failedCount() const { return m_failed; }
+  /// completed jobs per hour of wall-clock time since run() started
+  double imagesPerHour() const;
+
+private:
+  struct Job
+  {
+    int id;
+    QString targetPath;
+    QString logPath;
+    EvolutionParameters params;
+    EvolutionEngine *engine;
+    bool failed;
+    QAtomicInt cancelled;
+  };
+
+  class SliceRunnable;
+  friend class SliceRunnable;
+
+  /// runs one time slice of a job on a pool thread, then hands it back to the queue
+  void runSlice( Job *job );
+  /// starts slices for waiting jobs while there are free threads. called with m_mutex held
+  void dispatch();
+  /// records the end of a job, and deletes it. called with m_mutex held
+  void retire( Job *job );
+
+  EvolutionParameters m_params;
+  QThreadPool *m_pool;
+  QTextStream *m_report;
+  bool m_keepResults;
+  MetricsServer *m_metrics;
+
+  int m_maxActiveJobs;
+  int m_sliceTime;
+
+  QMutex m_mutex;
+  QWaitCondition m_changed;
+  bool m_started;
+  /// every job that hasn't finished, by id
+  QHash< int, Job* > m_jobs;
+  /// jobs that haven't been started yet
+  QQueue< Job* > m_pending;
+  /// started jobs waiting for their next slice, in round-robin order
+  QQueue< Job* > m_ready;
+  int m_activeJobs;
+  int m_runningSlices;
+  QList< Result > m_results;
+  /// scene types the runner initialised (such as starting the flame renderer), which stay up until the runner goes
+  QList< SceneType* > m_initialisedTypes;
+
+  QAtomicInt m_stopping;
+  int m_nextId;
+  int m_jobCount;
+  int m_completed;
+  int m_failed;
+  QElapsedTimer m_timer;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,369 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTextStream>
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include <algorithm>
+#include <functional>
+
+#include "randomiser.h"
+#include "benchtargets.h"
+#include "trianglescene.h"
+#include "faceweightedpixelsumfitness.h"
+#include "pluginregistry.h"
+#include "sceneplugin.h"
+#include "convergencebench.h"
+#include "fitnesskernels.h"
+
+namespace
+{
+
+/// one timed operation, with the settings it was run with
+struct BenchResult
+{
+  QString name;
+  QVariantMap params;
+  qint64 iterations;
+  double nsPerOp;
+  double minNsPerOp;
+};
+
+/** Times operations a batch at a time. Each benchmark is calibrated to a batch that takes about
+    the minimum time, and then timed over several batches. The median batch is reported, as it's
+    less thrown by the occasional interruption than the mean */
+
+class Bench
+{
+public:
+  Bench( const QString &filter, int minMs, int repeats )
+    : m_filter( filter )
+    , m_minMs( minMs )
+    , m_repeats( repeats )
+  {
+  }
+
+  /// times op, unless the name doesn't match the filter
+  void run( const QString &name, const QVariantMap &params, const std::function< void() > &op )
+  {
+    if ( ! m_filter.isEmpty() && ! name.contains( m_filter ) )
+      return;
+
+    // warm up, and find how many calls fill the minimum time
+    qint64 iterations = 1;
+    QElapsedTimer timer;
+    for( ;; )
+    {
+      timer.start();
+      for( qint64 i = 0; i < iterations; ++ i )
+        op();
+      if ( timer.elapsed() >= m_minMs || iterations >= ( Q_INT64_C( 1 ) << 40 ) )
+        break;
+      iterations *= 2;
+    }
+
+    QVector< double > batches;
+    for( int r = 0; r < m_repeats; ++ r )
+    {
+      timer.start();
+      for( qint64 i = 0; i < iterations; ++ i )
+        op();
+      batches << double( timer.nsecsElapsed() ) / iterations;
+    }
+    std::sort( batches.begin(), batches.end() );
+
+    BenchResult result;
+    result.name = name;
+    result.params = params;
+    result.iterations = iterations;
+    result.nsPerOp = batches.at( batches.count() / 2 );
+    result.minNsPerOp = batches.first();
+    m_results << result;
+  }
+
+  const QList< BenchResult > &results() const { return m_results; }
+
+private:
+  QString m_filter;
+  int m_minMs;
+  int m_repeats;
+  QList< BenchResult > m_results;
+};
+
+void benchTriangles( Bench &bench )
+{
+  QList< int > counts;
+  counts << 20 << 100 << 500;
+  QList< int > sizes;
+  sizes << 256 << 1024;
+
+  foreach( int size, sizes )
+  {
+    QImage image( size, size, QImage::Format_RGB32 );
+    foreach( int count, counts )
+    {
+      TriangleScene scene( count, size, size, QColor( 255, 255, 255 ) );
+      QVariantMap params;
+      params.insert( "triangles", count );
+      params.insert( "size", size );
+      bench.run( "render", params, [&]() { scene.renderTo( image ); } );
+    }
+  }
+
+  QVariantMap params;
+  params.insert( "triangles", 100 );
+  params.insert( "size", 1024 );
+
+  TriangleScene a( 100, 1024, 1024, QColor( 255, 255, 255 ) );
+  TriangleScene b( 100, 1024, 1024, QColor( 255, 255, 255 ) );
+
+  bench.run( "breed", params, [&]() {
+    QPair< AbstractScene*, AbstractScene* > children = a.breed( &b, 50 );
+    delete children.first;
+    delete children.second;
+  } );
+
+  // mutating the same scene over and over would drift, so each round mutates a fresh copy
+  bench.run( "mutate", params, [&]() {
+    TriangleScene copy( a );
+    copy.mutate( 50 );
+  } );
+
+  bench.run( "clone", params, [&]() { delete a.clone(); } );
+
+  // loading gets a saved scene to read, even if saving is filtered out
+  QByteArray data;
+  {
+    QDataStream ds( &data, QIODevice::WriteOnly );
+    a.saveToStream( ds );
+  }
+
+  bench.run( "saveToStream", params, [&]() {
+    data.clear();
+    QDataStream ds( &data, QIODevice::WriteOnly );
+    a.saveToStream( ds );
+  } );
+
+  bench.run( "loadFromStream", params, [&]() {
+    QDataStream ds( data );
+    TriangleScene loaded( 0, 0, 0, QColor() );
+    loaded.loadFromStream( ds );
+  } );
+}
+
+void benchFitness( Bench &bench )
+{
+  QList< int > sizes;
+  sizes << 256 << 1024 << 2048;
+
+  foreach( int size, sizes )
+  {
+    QImage target( syntheticTarget( "gradient", size ) );
+    QImage candidate( size, size, QImage::Format_RGB32 );
+    TriangleScene( 100, size, size, QColor( 255, 255, 255 ) ).renderTo( candidate );
+
+    // the faces are given rather than detected, as there are none in a synthetic target
+    FaceWeightedPixelSumFitness plain( target, 10, QList< QRect >() );
+    FaceWeightedPixelSumFitness withFace( target, 10, QList< QRect >() << QRect( size / 4, size / 4, size / 2, size / 2 ) );
+
+    QVariantMap params;
+    params.insert( "size", size );
+    params.insert( "faces", 0 );
+    bench.run( "getFitness", params, [&]() { plain.getFitness( candidate ); } );
+
+    params.insert( "faces", 1 );
+    bench.run( "getFitness", params, [&]() { withFace.getFitness( candidate ); } );
+  }
+}
+
+/// the same fitness, with every kernel variant the cpu supports, to see what each instruction set is worth
+void benchFitnessKernels( Bench &bench )
+{
+  int size = 1024;
+  QImage target( syntheticTarget( "gradient", size ) );
+  QImage candidate( size, size, QImage::Format_RGB32 );
+  TriangleScene( 100, size, size, QColor( 255, 255, 255 ) ).renderTo( candidate );
+  FaceWeightedPixelSumFitness fitness( target, 10, QList< QRect >() << QRect( size / 4, size / 4, size / 2, size / 2 ) );
+
+  FitnessKernels::Variant inUse = FitnessKernels::currentVariant();
+  for( int v = 0; v < FitnessKernels::VariantCount; ++ v )
+  {
+    FitnessKernels::Variant variant = FitnessKernels::Variant( v );
+    if ( ! FitnessKernels::setVariant( variant ) )
+      continue;
+
+    QVariantMap params;
+    params.insert( "size", size );
+    params.insert( "isa", FitnessKernels::variantName( variant ) );
+    bench.run( "fitnessKernel", params, [&]() { fitness.getFitness( candidate ); } );
+  }
+  FitnessKernels::setVariant( inUse );
+}
+
+/// flame serialisation needs the flame plugin, and a palette file to make random flames from
+void benchFlames( Bench &bench, const QString &palettesFile, QTextStream &err )
+{
+  SceneType *flames = PluginRegistry::instance().sceneType( "flames" );
+  if ( ! flames || palettesFile.isEmpty() )
+  {
+    err << "Skipping the flame benchmarks, as " << ( flames ? "no palette file was given" : "the flame plugin isn't installed" ) << endl;
+    return;
+  }
+
+  EvolutionParameters params;
+  params.sceneType = "flames";
+  params.palettesFile = palettesFile;
+  params.flameBackend = EvolutionParameters::CpuBackend;
+  if ( ! flames->isInitialised() && ! flames->initialise( params, 1 ) )
+  {
+    err << "Skipping the flame benchmarks, as the flame renderer couldn't be started" << endl;
+    return;
+  }
+
+  AbstractScene *scene = flames->createScene( params, 256, 256 );
+  QVariantMap benchParams;
+  benchParams.insert( "maxXforms", params.maxXforms );
+
+  QByteArray data;
+  {
+    QDataStream ds( &data, QIODevice::WriteOnly );
+    scene->saveToStream( ds );
+  }
+
+  bench.run( "flameSaveToStream", benchParams, [&]() {
+    data.clear();
+    QDataStream ds( &data, QIODevice::WriteOnly );
+    scene->saveToStream( ds );
+  } );
+
+  bench.run( "flameLoadFromStream", benchParams, [&]() {
+    QDataStream ds( data );
+    AbstractScene *loaded = flames->createEmptyScene( params, 256, 256 );
+    loaded->loadFromStream( ds );
+    delete loaded;
+  } );
+
+  delete scene;
+  flames->shutdown();
+}
+
+QString paramsText( const QVariantMap &params )
+{
+  QStringList pairs;
+  for( QVariantMap::const_iterator i = params.constBegin(); i != params.constEnd(); ++ i )
+    pairs << i.key() + "=" + i.value().toString();
+  return pairs.join( ";" );
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+  QCoreApplication a( argc, argv );
+  a.setApplicationName( "triangles-bench" );
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription( "Times the render, fitness and genetic operator hot paths, on synthetic targets with fixed seeds. "
+                                    "With --convergence, times whole runs instead." );
+  parser.addHelpOption();
+
+  QCommandLineOption csvOption( "csv", "Writes CSV rather than JSON." );
+  QCommandLineOption seedOption( "seed", "Seed for the random scenes. Defaults to 1.", "seed", "1" );
+  QCommandLineOption filterOption( "filter", "Only runs benchmarks whose name contains <text>.", "text" );
+  QCommandLineOption minTimeOption( "min-time", "Milliseconds each timed batch should take. Defaults to 100.", "ms", "100" );
+  QCommandLineOption repeatsOption( "repeats", "Number of timed batches per benchmark. Defaults to 5.", "count", "5" );
+  QCommandLineOption palettesOption( "palettes", "Palette file for the flame benchmarks, which are skipped without one.", "file" );
+  parser.addOption( csvOption );
+  parser.addOption( seedOption );
+  parser.addOption( filterOption );
+  parser.addOption( minTimeOption );
+  parser.addOption( repeatsOption );
+  parser.addOption( palettesOption );
+  QCommandLineOption convergenceOption( "convergence", "Records best fitness against time and evaluations over whole runs, rather than timing the hot paths." );
+  QCommandLineOption corpusOption( "corpus", "With --convergence, also runs every image in <dir>.", "dir" );
+  QCommandLineOption sizeOption( "size", "With --convergence, the size targets are scaled to. Defaults to 128.", "pixels", "128" );
+  QCommandLineOption seedsOption( "seeds", "With --convergence, the number of seeds each target is run with, counting up from --seed. Defaults to 3.", "count", "3" );
+  QCommandLineOption parametersOption( "parameters", "With --convergence, an ini file of evolution parameters. Runs stop after 2000 generations unless it sets a budget.", "file" );
+  parser.addOption( convergenceOption );
+  parser.addOption( corpusOption );
+  parser.addOption( sizeOption );
+  parser.addOption( seedsOption );
+  parser.addOption( parametersOption );
+  QCommandLineOption isaOption( "isa", "Runs the fitness kernels built for <name> (baseline, sse4.1, avx2 or avx512) rather than the best this cpu supports.", "name" );
+  parser.addOption( isaOption );
+
+  parser.process( a );
+
+  QTextStream out( stdout );
+  QTextStream err( stderr );
+
+  quint32 seed = parser.value( seedOption ).toUInt();
+
+  if ( parser.isSet( isaOption ) && ! FitnessKernels::setVariant( FitnessKernels::variantFromName( parser.value( isaOption ) ) ) )
+  {
+    err << "The " << parser.value( isaOption ) << " fitness kernels aren't supported here" << endl;
+    return 1;
+  }
+
+  if ( parser.isSet( convergenceOption ) )
+  {
+    EvolutionParameters params;
+    if ( parser.isSet( parametersOption ) && ! params.load( parser.value( parametersOption ) ) )
+    {
+      err << "Couldn't read parameters from " << parser.value( parametersOption ) << endl;
+      return 1;
+    }
+    if ( params.maxGenerations == 0 && params.maxSeconds == 0 && params.targetFitness < 0 )
+      params.maxGenerations = 2000;
+
+    ConvergenceBench convergence( params, qMax( 16, parser.value( sizeOption ).toInt() ), qMax( 1, parser.value( seedsOption ).toInt() ), seed );
+    convergence.addSyntheticTargets();
+    if ( parser.isSet( corpusOption ) && ! convergence.addTargets( parser.value( corpusOption ) ) )
+    {
+      err << "Couldn't read the corpus in " << parser.value( corpusOption ) << endl;
+      return 1;
+    }
+
+    return convergence.run( parser.isSet( csvOption ), out, err ) ? 0 : 1;
+  }
+
+  Randomiser::seed( seed );
+
+  Bench bench( parser.value( filterOption ), qMax( 1, parser.value( minTimeOption ).toInt() ), qMax( 1, parser.value( repeatsOption ).toInt() ) );
+  benchTriangles( bench );
+  benchFitness( bench );
+  benchFitnessKernels( bench );
+  benchFlames( bench, parser.value( palettesOption ), err );
+
+  if ( parser.isSet( csvOption ) )
+  {
+    out << "name,params,iterations,ns_per_op,min_ns_per_op" << endl;
+    foreach( const BenchResult &result, bench.results() )
+      out << result.name << "," << paramsText( result.params ) << "," << result.iterations << "," << result.nsPerOp << "," << result.minNsPerOp << endl;
+  } else {
+    QJsonArray results;
+    foreach( const BenchResult &result, bench.results() )
+    {
+      QJsonObject o;
+      o.insert( "name", result.name );
+      o.insert( "params", QJsonObject::fromVariantMap( result.params ) );
+      o.insert( "iterations", double( result.iterations ) );
+      o.insert( "nsPerOp", result.nsPerOp );
+      o.insert( "minNsPerOp", result.minNsPerOp );
+      results.append( o );
+    }
+
+    QJsonObject report;
+    report.insert( "seed", double( seed ) );
+    report.insert( "qt", QString( qVersion() ) );
+    report.insert( "isa", FitnessKernels::variantName( FitnessKernels::currentVariant() ) );
+    report.insert( "results", results );
+    out << QJsonDocument( report ).toJson();
+  }
+
+  return 0;
+}
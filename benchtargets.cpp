@@ -0,0 +1,54 @@
+#include "benchtargets.h"
+
+#include <QPainter>
+
+QStringList syntheticTargetNames()
+{
+  return QStringList() << "gradient" << "rings" << "checks";
+}
+
+QImage syntheticTarget( const QString &name, int size )
+{
+  QImage image( size, size, QImage::Format_RGB32 );
+  QPainter painter( &image );
+  painter.setPen( Qt::NoPen );
+
+  if ( name == "rings" )
+  {
+    // smooth curves, which straight-edged triangles find hard
+    image.fill( QColor( 250, 245, 230 ) );
+    for( int i = 8; i > 0; -- i )
+    {
+      int r = size * i / 16;
+      painter.setBrush( i % 2 ? QColor( 20 + i * 25, 40, 140 ) : QColor( 240, 200 - i * 15, 60 ) );
+      painter.drawEllipse( QPoint( size / 2, size / 2 ), r, r );
+    }
+  }
+  else if ( name == "checks" )
+  {
+    // hard edges and lots of them, with a diagonal across the grid
+    int cell = qMax( 1, size / 8 );
+    for( int y = 0; y < size; y += cell )
+    {
+      for( int x = 0; x < size; x += cell )
+        painter.fillRect( x, y, cell, cell, ( ( x + y ) / cell ) % 2 ? QColor( 30, 30, 30 ) : QColor( 220, 220, 220 ) );
+    }
+    painter.setBrush( QColor( 200, 30, 30, 180 ) );
+    painter.drawPolygon( QPolygon() << QPoint( 0, size ) << QPoint( size, 0 ) << QPoint( size, size / 4 ) << QPoint( size / 4, size ) );
+  }
+  else
+  {
+    // a gradient with a few shapes on top
+    QLinearGradient gradient( 0, 0, size, size );
+    gradient.setColorAt( 0, QColor( 30, 60, 120 ) );
+    gradient.setColorAt( 1, QColor( 230, 200, 90 ) );
+    painter.fillRect( image.rect(), gradient );
+
+    painter.setBrush( QColor( 200, 40, 40 ) );
+    painter.drawEllipse( QRect( size / 8, size / 8, size / 3, size / 3 ) );
+    painter.setBrush( QColor( 40, 160, 60, 160 ) );
+    painter.drawRect( QRect( size / 2, size / 3, size / 3, size / 2 ) );
+  }
+
+  return image;
+}
@@ -0,0 +1,14 @@
+#ifndef BENCHTARGETS_H
+#define BENCHTARGETS_H
+
+#include <QImage>
+#include <QStringList>
+
+/// names of the synthetic targets the benchmarks use
+QStringList syntheticTargetNames();
+
+/// draws a synthetic target, the same way every time, so benchmarks need no images
+/// and give the same results on every machine
+QImage syntheticTarget( const QString &name, int size );
+
+#endif // BENCHTARGETS_H
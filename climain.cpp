@@ -0,0 +1,405 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QTimer>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFileInfo>
+
+#include <signal.h>
+
+#include "evolutionengine.h"
+#include "batchrunner.h"
+#include "evolutiondaemon.h"
+#include "tracer.h"
+#include "metricsserver.h"
+#include "fitnesskernels.h"
+#include "numatopology.h"
+
+static EvolutionEngine *s_engine = 0;
+static BatchRunner *s_batch = 0;
+static volatile sig_atomic_t s_daemonStop = 0;
+
+/// the last age runs forever, so ctrl-c (or a scheduler's sigterm) ends the run and still writes out the results
+static void stopEngine( int )
+{
+  if ( s_engine )
+    s_engine->stop();
+  if ( s_batch )
+    s_batch->stop();
+  s_daemonStop = 1;
+}
+
+/// optimises every image in a directory or manifest, sharing the thread pool between them
+static int runBatch( const QString &path, const EvolutionParameters &params, int maxJobs, MetricsServer *metrics, QTextStream &out, QTextStream &err )
+{
+  if ( params.maxGenerations == 0 && params.maxSeconds == 0 && params.targetFitness < 0 )
+  {
+    err << "Batch mode needs a budget (maxGenerations, maxSeconds or targetFitness) in the parameters" << endl;
+    return 1;
+  }
+
+  BatchRunner batch( params, QThreadPool::globalInstance() );
+  if ( ! batch.addJobs( path ) )
+  {
+    err << "No targets found in " << path << endl;
+    return 1;
+  }
+  if ( maxJobs > 0 )
+    batch.setMaxActiveJobs( maxJobs );
+  batch.setReportStream( &out );
+  batch.setMetricsServer( metrics );
+
+  s_batch = &batch;
+  signal( SIGINT, stopEngine );
+  signal( SIGTERM, stopEngine );
+
+  batch.run();
+
+  s_batch = 0;
+
+  return batch.failedCount() ? 1 : 0;
+}
+
+/// keeps the renderer and thread pool up, and runs whatever jobs clients send over the socket
+static int runDaemon( QCoreApplication &a, const QString &socket, const EvolutionParameters &params, MetricsServer *metrics, QTextStream &err )
+{
+  EvolutionDaemon daemon( params, QThreadPool::globalInstance() );
+  daemon.setMetricsServer( metrics );
+  if ( ! daemon.listen( socket ) )
+  {
+    err << "Couldn't listen on " << socket << ": " << daemon.errorString() << endl;
+    return 1;
+  }
+
+  signal( SIGINT, stopEngine );
+  signal( SIGTERM, stopEngine );
+
+  // the signal handler can only set a flag, so look for it from the event loop
+  QTimer signalTimer;
+  QObject::connect( &signalTimer, &QTimer::timeout, [&]() {
+    if ( s_daemonStop )
+    {
+      signalTimer.stop();
+      daemon.shutdown();
+    }
+  } );
+  signalTimer.start( 100 );
+
+  return a.exec();
+}
+
+/// pins the pool's workers across the NUMA nodes, before anything runs on them
+static bool pinWorkers( QTextStream &err )
+{
+  QThreadPool *pool = QThreadPool::globalInstance();
+  if ( ! NumaTopology::pinPool( pool ) )
+  {
+    err << "Worker threads couldn't be pinned to cpus" << endl;
+    return false;
+  }
+
+  err << "Pinned " << pool->maxThreadCount() << " workers across " << NumaTopology::nodeCount() << " NUMA node(s)" << endl;
+  return true;
+}
+
+/// sends one command to a daemon, and prints the replies as they come in until done() says to stop
+template< typename Done >
+static int sendToDaemon( const QString &socket, const QVariantMap &command, Done done, QTextStream &out, QTextStream &err )
+{
+  QLocalSocket client;
+  client.connectToServer( socket );
+  if ( ! client.waitForConnected( 5000 ) )
+  {
+    err << "Couldn't connect to " << socket << ": " << client.errorString() << endl;
+    return 1;
+  }
+
+  client.write( QJsonDocument( QJsonObject::fromVariantMap( command ) ).toJson( QJsonDocument::Compact ) + "\n" );
+  client.flush();
+
+  while( client.state() == QLocalSocket::ConnectedState || client.bytesAvailable() )
+  {
+    if ( ! client.canReadLine() && ! client.waitForReadyRead( -1 ) )
+      break;
+
+    while( client.canReadLine() )
+    {
+      QByteArray line( client.readLine().trimmed() );
+      out << line << endl;
+
+      QVariantMap event( QJsonDocument::fromJson( line ).object().toVariantMap() );
+      if ( event.value( "event" ) == "error" )
+        return 1;
+      if ( done( event ) )
+        return event.value( "failed" ).toBool() ? 1 : 0;
+    }
+  }
+
+  err << "Lost the connection to " << socket << endl;
+  return 1;
+}
+
+int main( int argc, char *argv[] )
+{
+  QCoreApplication a( argc, argv );
+  a.setApplicationName( "triangles-cli" );
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription( "Evolves a scene to approximate a target image, without needing a display." );
+  parser.addHelpOption();
+  parser.addPositionalArgument( "target", "Image to approximate (or a directory or manifest of images, with --batch)." );
+  parser.addPositionalArgument( "parameters", "Ini file of evolution parameters. Defaults are used if omitted.", "[parameters]" );
+
+  QCommandLineOption outputOption( QStringList() << "o" << "output", "Directory for the logs and svgs. Defaults to <target>.triangles", "dir" );
+  QCommandLineOption progressOption( QStringList() << "p" << "progress", "Seconds between progress lines, or 0 for none. Defaults to 5.", "seconds", "5" );
+  QCommandLineOption writeParametersOption( "write-parameters", "Writes the default parameters to <file> and exits.", "file" );
+  QCommandLineOption batchOption( "batch", "Optimises every image in a directory, or listed in a manifest file, concurrently. Each run stops when the budget in the parameters is reached." );
+  QCommandLineOption jobsOption( "jobs", "Maximum number of batch images in progress at once. Defaults to twice the thread count.", "count" );
+  QCommandLineOption threadsOption( "threads", "Number of worker threads. Defaults to the number of cores.", "count" );
+  QCommandLineOption pinThreadsOption( "pin-threads", "Pins each worker thread to a cpu, spread across the NUMA nodes, and keeps a copy of the target on each node." );
+  parser.addOption( outputOption );
+  parser.addOption( progressOption );
+  parser.addOption( writeParametersOption );
+  parser.addOption( batchOption );
+  parser.addOption( jobsOption );
+  QCommandLineOption daemonOption( "daemon", "Runs as a daemon, taking jobs from clients on <socket>. The parameters are the defaults for every job.", "socket" );
+  QCommandLineOption connectOption( "connect", "Submits the target to the daemon on <socket>, and prints its progress until it finishes.", "socket" );
+  QCommandLineOption cancelOption( "cancel", "With --connect, cancels job <id> instead of submitting a target.", "id" );
+  parser.addOption( threadsOption );
+  parser.addOption( pinThreadsOption );
+  parser.addOption( daemonOption );
+  parser.addOption( connectOption );
+  parser.addOption( cancelOption );
+  QCommandLineOption traceOption( "trace", "Records a timeline of the last few thousand tasks on each thread to <file>, in Chrome trace format. "
+                                           "With --connect, asks the daemon to record one instead.", "file" );
+  QCommandLineOption traceSecondsOption( "trace-seconds", "With --connect and --trace, how long the daemon records for. Defaults to 10.", "seconds", "10" );
+  parser.addOption( traceOption );
+  parser.addOption( traceSecondsOption );
+  QCommandLineOption metricsOption( "metrics", "Serves Prometheus metrics over http on localhost:<port>, or on a unix socket if given a path.", "port|socket" );
+  parser.addOption( metricsOption );
+  QCommandLineOption isaOption( "isa", "Runs the fitness kernels built for <name> (baseline, sse4.1, avx2 or avx512) rather than the best this cpu supports.", "name" );
+  QCommandLineOption checkIsaOption( "check-isa", "Lists the fitness kernel variants this cpu supports, checks they all agree, and exits." );
+  parser.addOption( isaOption );
+  parser.addOption( checkIsaOption );
+
+  parser.process( a );
+
+  QTextStream out( stdout );
+  QTextStream err( stderr );
+
+  EvolutionParameters params;
+
+  if ( parser.isSet( writeParametersOption ) )
+  {
+    if ( ! params.save( parser.value( writeParametersOption ) ) )
+    {
+      err << "Couldn't write " << parser.value( writeParametersOption ) << endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if ( parser.isSet( isaOption ) && ! FitnessKernels::setVariant( FitnessKernels::variantFromName( parser.value( isaOption ) ) ) )
+  {
+    err << "The " << parser.value( isaOption ) << " fitness kernels aren't supported here" << endl;
+    return 1;
+  }
+
+  if ( parser.isSet( checkIsaOption ) )
+  {
+    for( int v = 0; v < FitnessKernels::VariantCount; ++ v )
+    {
+      FitnessKernels::Variant variant = FitnessKernels::Variant( v );
+      out << FitnessKernels::variantName( variant ) << ": " << ( FitnessKernels::isSupported( variant ) ? "supported" : "not supported" )
+          << ( variant == FitnessKernels::currentVariant() ? ", in use" : "" ) << endl;
+    }
+
+    QString failure;
+    if ( ! FitnessKernels::selfCheck( &failure ) )
+    {
+      err << failure << endl;
+      return 1;
+    }
+    out << "Every supported variant agrees with the baseline" << endl;
+    return 0;
+  }
+
+  QStringList args( parser.positionalArguments() );
+
+  if ( parser.isSet( connectOption ) && parser.isSet( cancelOption ) )
+  {
+    QVariantMap command;
+    command.insert( "command", "cancel" );
+    command.insert( "job", parser.value( cancelOption ).toInt() );
+    return sendToDaemon( parser.value( connectOption ), command, []( const QVariantMap & ) { return true; }, out, err );
+  }
+
+  if ( parser.isSet( connectOption ) && parser.isSet( traceOption ) )
+  {
+    // the daemon writes the file, so it needs a path that means the same thing from where it's running
+    QVariantMap command;
+    command.insert( "command", "trace" );
+    command.insert( "output", QFileInfo( parser.value( traceOption ) ).absoluteFilePath() );
+    command.insert( "seconds", parser.value( traceSecondsOption ).toInt() );
+    return sendToDaemon( parser.value( connectOption ), command, []( const QVariantMap &event ) { return event.value( "event" ) == "traced"; }, out, err );
+  }
+
+  if ( parser.isSet( daemonOption ) )
+  {
+    // no target, just the optional default parameters
+    if ( args.count() > 1 )
+      parser.showHelp( 1 );
+    if ( args.count() == 1 && ! params.load( args[0] ) )
+    {
+      err << "Couldn't read parameters from " << args[0] << endl;
+      return 1;
+    }
+
+    if ( parser.isSet( threadsOption ) && parser.value( threadsOption ).toInt() > 0 )
+      QThreadPool::globalInstance()->setMaxThreadCount( parser.value( threadsOption ).toInt() );
+    if ( parser.isSet( pinThreadsOption ) && ! pinWorkers( err ) )
+      return 1;
+
+    MetricsServer metrics;
+    if ( parser.isSet( metricsOption ) && ! metrics.listen( parser.value( metricsOption ) ) )
+    {
+      err << "Couldn't serve metrics on " << parser.value( metricsOption ) << ": " << metrics.errorString() << endl;
+      return 1;
+    }
+
+    return runDaemon( a, parser.value( daemonOption ), params, parser.isSet( metricsOption ) ? &metrics : 0, err );
+  }
+
+  if ( args.count() < 1 || args.count() > 2 )
+    parser.showHelp( 1 );
+
+  if ( args.count() == 2 && ! params.load( args[1] ) )
+  {
+    err << "Couldn't read parameters from " << args[1] << endl;
+    return 1;
+  }
+
+  if ( parser.isSet( connectOption ) )
+  {
+    // the daemon resolves paths from its own working directory
+    QVariantMap command;
+    command.insert( "command", "submit" );
+    command.insert( "target", QFileInfo( args[0] ).absoluteFilePath() );
+    if ( parser.isSet( outputOption ) )
+      command.insert( "output", QFileInfo( parser.value( outputOption ) ).absoluteFilePath() );
+    if ( args.count() == 2 )
+      command.insert( "parameters", params.toVariantMap() );
+
+    int job = 0;
+    return sendToDaemon( parser.value( connectOption ), command, [&job]( const QVariantMap &event ) {
+      if ( event.value( "event" ) == "accepted" )
+        job = event.value( "job" ).toInt();
+      return event.value( "event" ) == "finished" && event.value( "job" ).toInt() == job;
+    }, out, err );
+  }
+
+  if ( parser.isSet( threadsOption ) && parser.value( threadsOption ).toInt() > 0 )
+    QThreadPool::globalInstance()->setMaxThreadCount( parser.value( threadsOption ).toInt() );
+  if ( parser.isSet( pinThreadsOption ) && ! pinWorkers( err ) )
+    return 1;
+
+  // a local run is traced from start to finish, and the buffers keep the end of it
+  if ( parser.isSet( traceOption ) )
+    Tracer::instance().start();
+
+  MetricsServer metrics;
+  if ( parser.isSet( metricsOption ) && ! metrics.listen( parser.value( metricsOption ) ) )
+  {
+    err << "Couldn't serve metrics on " << parser.value( metricsOption ) << ": " << metrics.errorString() << endl;
+    return 1;
+  }
+
+  if ( parser.isSet( batchOption ) )
+  {
+    int result = runBatch( args[0], params, parser.value( jobsOption ).toInt(), parser.isSet( metricsOption ) ? &metrics : 0, out, err );
+    if ( parser.isSet( traceOption ) && ! Tracer::instance().write( parser.value( traceOption ) ) )
+      err << "Couldn't write the trace to " << parser.value( traceOption ) << endl;
+    return result;
+  }
+
+  TargetImage target( TargetImage::load( args[0], qint64( params.memoryBudgetMB ) * 1024 * 1024 ) );
+  if ( target.isNull() )
+  {
+    err << "Couldn't load target image " << args[0] << endl;
+    return 1;
+  }
+
+  QString logPath( parser.isSet( outputOption ) ? parser.value( outputOption ) : args[0] + ".triangles" );
+
+  EvolutionEngine engine( target, logPath, params );
+  if ( parser.isSet( metricsOption ) )
+    engine.setMetrics( &metrics, QFileInfo( args[0] ).fileName() );
+  if ( ! engine.initialise() )
+  {
+    err << engine.errorString() << endl;
+    return 1;
+  }
+
+  s_engine = &engine;
+  signal( SIGINT, stopEngine );
+  signal( SIGTERM, stopEngine );
+
+  qint64 progressInterval = parser.value( progressOption ).toLongLong() * 1000;
+  QElapsedTimer progressTimer;
+  progressTimer.start();
+
+  while( engine.step() )
+  {
+    if ( progressInterval > 0 && progressTimer.elapsed() >= progressInterval )
+    {
+      EvolutionSnapshot *snapshot = engine.snapshots().take();
+      if ( snapshot )
+      {
+        out << "age " << snapshot->age << " culture " << snapshot->culture << "/" << snapshot->maxCultures
+            << " iteration " << snapshot->iterations << "/" << snapshot->maxIterations
+            << " current " << snapshot->currentFitness << " best " << snapshot->bestFitness
+            << " (" << snapshot->iterationsPerSec << "/sec, " << snapshot->evaluationsPerSec << " evaluations/sec)";
+        if ( snapshot->screening.screened )
+        {
+          out << " screened out " << snapshot->screening.rejected << "/" << snapshot->screening.screened
+              << ", " << snapshot->screening.disagreementRate() * 100.0 << "% disagreement";
+        }
+        out << endl;
+        delete snapshot;
+      }
+      progressTimer.restart();
+    }
+  }
+
+  engine.finish();
+  s_engine = 0;
+
+  out << "finished: " << EvolutionEngine::stopReasonName( engine.stopReason() ) << ", best fitness " << engine.bestFitness()
+      << " after " << engine.totalGenerations() << " generations" << endl;
+
+  const ScreeningStats &screening( engine.screeningStats() );
+  if ( screening.screened )
+  {
+    out << "screening: " << screening.rejected << " of " << screening.screened << " children rejected from previews. "
+        << screening.falsePasses << " of " << screening.confirmed << " passed were worse than the cutoff, "
+        << screening.falseRejects << " of " << screening.audited << " audited rejections would have made it ("
+        << screening.disagreementRate() * 100.0 << "% disagreement)" << endl;
+  }
+
+  const PhaseStats &phases( engine.phaseStats() );
+  out << "profile: " << phases.evaluations << " evaluations, " << phases.allocations << " allocations in "
+      << engine.activeTime() << "ms. " << phases.summary() << endl;
+  if ( phases.cacheLookups )
+    out << "fitness cache: " << phases.cacheHits << " of " << phases.cacheLookups << " children reused a known fitness ("
+        << phases.cacheHitRate() * 100.0 << "%)" << endl;
+
+  if ( parser.isSet( traceOption ) && ! Tracer::instance().write( parser.value( traceOption ) ) )
+    err << "Couldn't write the trace to " << parser.value( traceOption ) << endl;
+
+  return 0;
+}
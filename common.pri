@@ -0,0 +1,45 @@
+# compiler settings shared by the engine and the plugins
+
+macx {
+  # homebrew installs into /usr/local
+  LIBS += -L/usr/local/lib
+
+  INCLUDEPATH += /usr/local/include
+
+  QMAKE_MAC_SDK = macosx10.9
+  QMAKE_MACOSX_DEPLOYMENT_TARGET = 10.9
+
+  QMAKE_CXXFLAGS += -stdlib=libc++
+}
+
+native {
+  QMAKE_CXXFLAGS += -march=native
+} else {
+  QMAKE_CXXFLAGS += -march=k8
+}
+
+QMAKE_CXXFLAGS_RELEASE += -O2
+
+QMAKE_CXXFLAGS += -std=c++11
+
+# fractorium doesn't care about warnings! ^_^
+CONFIG += warn_off
+QMAKE_CXXFLAGS += -Wnon-virtual-dtor
+QMAKE_CXXFLAGS += -Wshadow
+QMAKE_CXXFLAGS += -Winit-self
+QMAKE_CXXFLAGS += -Wredundant-decls
+QMAKE_CXXFLAGS += -Wcast-align
+QMAKE_CXXFLAGS += -Winline
+QMAKE_CXXFLAGS += -Wunreachable-code
+QMAKE_CXXFLAGS += -Wmissing-include-dirs
+QMAKE_CXXFLAGS += -Wswitch-enum
+QMAKE_CXXFLAGS += -Wswitch-default
+QMAKE_CXXFLAGS += -Wmain
+QMAKE_CXXFLAGS += -Wzero-as-null-pointer-constant
+QMAKE_CXXFLAGS += -Wfatal-errors
+QMAKE_CXXFLAGS += -Wall -fpermissive
+QMAKE_CXXFLAGS += -Wold-style-cast
+QMAKE_CXXFLAGS += -Wno-unused-parameter
+QMAKE_CXXFLAGS += -Wno-unused-function
+QMAKE_CXXFLAGS += -Wold-style-cast
+
@@ -0,0 +1,225 @@
+#include "convergencebench.h"
+
+#include <QDir>
+#include <QImageReader>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include "evolutionengine.h"
+#include "randomiser.h"
+#include "benchtargets.h"
+
+namespace
+{
+
+/// the best fitness at one point in a run
+struct Sample
+{
+  double ms;
+  double evaluations;
+  float fitness;
+};
+
+struct Run
+{
+  QString target;
+  quint32 seed;
+  QVector< Sample > curve;
+  double ms;
+  double evaluations;
+  quint64 generations;
+};
+
+/// fractions of the starting fitness that time-to-threshold is measured for
+QList< double > thresholds()
+{
+  return QList< double >() << 0.5 << 0.25 << 0.1;
+}
+
+/// the first sample where the best fitness had fallen to threshold times where it started, or -1
+int firstBelow( const QVector< Sample > &curve, double threshold )
+{
+  for( int i = 0; i < curve.count(); ++ i )
+  {
+    if ( curve.at( i ).fitness <= threshold * curve.first().fitness )
+      return i;
+  }
+  return -1;
+}
+
+/// area under the relative best fitness, over time or evaluations (picked by x), divided by the length
+/// of the run. 1 means no progress at all, and smaller is better. the best holds from one sample until the next
+double area( const QVector< Sample > &curve, double end, double Sample::*x )
+{
+  double start = curve.first().*x;
+  if ( end <= start || curve.first().fitness <= 0 )
+    return 1;
+
+  double sum = 0;
+  for( int i = 0; i < curve.count(); ++ i )
+  {
+    double next = i + 1 < curve.count() ? curve.at( i + 1 ).*x : end;
+    sum += curve.at( i ).fitness / curve.first().fitness * ( next - curve.at( i ).*x );
+  }
+  return sum / ( end - start );
+}
+
+}
+
+ConvergenceBench::ConvergenceBench( const EvolutionParameters &params, int size, int seeds, quint32 firstSeed )
+  : m_params( params )
+  , m_size( size )
+  , m_seeds( seeds )
+  , m_firstSeed( firstSeed )
+{
+}
+
+void ConvergenceBench::addSyntheticTargets()
+{
+  foreach( QString name, syntheticTargetNames() )
+    m_targets << qMakePair( name, syntheticTarget( name, m_size ) );
+}
+
+bool ConvergenceBench::addTargets( const QString &path )
+{
+  QDir dir( path );
+  if ( ! dir.exists() )
+    return false;
+
+  QStringList filters;
+  foreach( QByteArray format, QImageReader::supportedImageFormats() )
+    filters << "*." + QString::fromLatin1( format );
+
+  foreach( QString fileName, dir.entryList( filters, QDir::Files, QDir::Name ) )
+  {
+    QImage image( dir.absoluteFilePath( fileName ) );
+    if ( ! image.isNull() )
+      m_targets << qMakePair( fileName, image.scaled( m_size, m_size, Qt::KeepAspectRatio, Qt::SmoothTransformation ) );
+  }
+  return true;
+}
+
+bool ConvergenceBench::run( bool csv, QTextStream &out, QTextStream &err )
+{
+  QList< Run > runs;
+
+  for( int t = 0; t < m_targets.count(); ++ t )
+  {
+    for( int s = 0; s < m_seeds; ++ s )
+    {
+      Run run;
+      run.target = m_targets.at( t ).first;
+      run.seed = m_firstSeed + s;
+
+      QTemporaryDir logDir;
+      Randomiser::seed( run.seed );
+      EvolutionEngine engine( m_targets.at( t ).second, logDir.path(), m_params );
+      // one thread, so the same seed always breeds the same scenes
+      engine.setThreadPool( 0 );
+      if ( ! engine.initialise() )
+      {
+        err << "Couldn't start a run on " << run.target << ": " << engine.errorString() << endl;
+        return false;
+      }
+
+      QElapsedTimer timer;
+      timer.start();
+      while( engine.step() )
+      {
+        if ( run.curve.isEmpty() || engine.bestFitness() != run.curve.last().fitness )
+        {
+          Sample sample;
+          sample.ms = timer.nsecsElapsed() / 1e6;
+          sample.evaluations = engine.evaluations();
+          sample.fitness = engine.bestFitness();
+          run.curve << sample;
+        }
+      }
+      run.ms = timer.nsecsElapsed() / 1e6;
+      run.evaluations = engine.evaluations();
+      run.generations = engine.totalGenerations();
+
+      // writing out the svgs isn't part of converging, so it's left out of the time
+      engine.finish();
+
+      if ( run.curve.isEmpty() )
+      {
+        err << "The run on " << run.target << " stopped before its first generation" << endl;
+        return false;
+      }
+
+      err << run.target << " seed " << run.seed << ": " << run.generations << " generations in " << run.ms << "ms" << endl;
+      runs << run;
+    }
+  }
+
+  if ( csv )
+  {
+    out << "target,seed,initial_fitness,final_fitness,ms,evaluations,generations";
+    foreach( double threshold, thresholds() )
+      out << ",ms_to_" << threshold << ",evaluations_to_" << threshold;
+    out << ",auc_time,auc_evaluations" << endl;
+
+    foreach( const Run &run, runs )
+    {
+      out << run.target << "," << run.seed << "," << run.curve.first().fitness << "," << run.curve.last().fitness << ","
+          << run.ms << "," << run.evaluations << "," << run.generations;
+      foreach( double threshold, thresholds() )
+      {
+        int i = firstBelow( run.curve, threshold );
+        if ( i < 0 )
+          out << ",,";
+        else
+          out << "," << run.curve.at( i ).ms << "," << run.curve.at( i ).evaluations;
+      }
+      out << "," << area( run.curve, run.ms, &Sample::ms ) << "," << area( run.curve, run.evaluations, &Sample::evaluations ) << endl;
+    }
+    return true;
+  }
+
+  QJsonArray jsonRuns;
+  foreach( const Run &run, runs )
+  {
+    QJsonObject o;
+    o.insert( "target", run.target );
+    o.insert( "seed", double( run.seed ) );
+    o.insert( "initialFitness", run.curve.first().fitness );
+    o.insert( "finalFitness", run.curve.last().fitness );
+    o.insert( "ms", run.ms );
+    o.insert( "evaluations", run.evaluations );
+    o.insert( "generations", double( run.generations ) );
+
+    // null where the run never got that far
+    QJsonObject msTo;
+    QJsonObject evaluationsTo;
+    foreach( double threshold, thresholds() )
+    {
+      int i = firstBelow( run.curve, threshold );
+      msTo.insert( QString::number( threshold ), i < 0 ? QJsonValue() : QJsonValue( run.curve.at( i ).ms ) );
+      evaluationsTo.insert( QString::number( threshold ), i < 0 ? QJsonValue() : QJsonValue( run.curve.at( i ).evaluations ) );
+    }
+    o.insert( "msToThreshold", msTo );
+    o.insert( "evaluationsToThreshold", evaluationsTo );
+    o.insert( "aucTime", area( run.curve, run.ms, &Sample::ms ) );
+    o.insert( "aucEvaluations", area( run.curve, run.evaluations, &Sample::evaluations ) );
+
+    QJsonArray curve;
+    foreach( const Sample &sample, run.curve )
+      curve.append( QJsonArray() << sample.ms << sample.evaluations << sample.fitness );
+    o.insert( "curve", curve );
+
+    jsonRuns.append( o );
+  }
+
+  QJsonObject report;
+  report.insert( "size", m_size );
+  report.insert( "parameters", QJsonObject::fromVariantMap( m_params.toVariantMap() ) );
+  report.insert( "runs", jsonRuns );
+  out << QJsonDocument( report ).toJson();
+
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef CONVERGENCEBENCH_H
+#define CONVERGENCEBENCH_H
+
+#include <QString>
+#include <QImage>
+#include <QList>
+#include <QPair>
+
+#include "evolutionparameters.h"
+
+class QTextStream;
+
+/** Runs the whole evolution loop against a fixed corpus of targets and seeds, recording how the best
+    fitness falls over wall-clock time and over evaluations. Faster generations don't help if the
+    search then needs more of them, so this is what to compare when an algorithm changes.
+
+    Every run is single-threaded and seeded, so the sequence of scenes is the same from build to build
+    unless the algorithm changes, and only the times differ. Fitness is taken relative to the best of
+    the first population, so runs on different targets are on the same scale */
+
+class ConvergenceBench
+{
+public:
+  ConvergenceBench( const EvolutionParameters &params, int size, int seeds, quint32 firstSeed );
+
+  /// adds the built-in synthetic targets to the corpus
+  void addSyntheticTargets();
+  /// adds every image in a directory to the corpus, scaled down to the benchmark size
+  bool addTargets( const QString &path );
+
+  /// runs every target with every seed, and writes the results as JSON, or CSV with one line per run
+  bool run( bool csv, QTextStream &out, QTextStream &err );
+
+private:
+  EvolutionParameters m_params;
+  int m_size;
+  int m_seeds;
+  quint32 m_firstSeed;
+  QList< QPair< QString, QImage > > m_targets;
+};
+
+#endif // CONVERGENCEBENCH_H
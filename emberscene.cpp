@@ -3,15 +3,25 @@
 #include <EmberToXml.h>
 #include <XmlToEmber.h>
 
+#include "randomiser.h"
+#include "tracer.h"
+
 #include <QFile>
+#include <QThread>
+
+QMutex EmberScene::s_poolMutex;
+QWaitCondition EmberScene::s_rendererReturned;
+EmberScene::Backend EmberScene::s_backend = EmberScene::OpenCLBackend;
+QList< EmberScene::PooledRenderer* > EmberScene::s_idleRenderers;
+QList< EmberScene::PooledRenderer* > EmberScene::s_renderers;
+int EmberScene::s_maxRenderers = 0;
 
-QMutex EmberScene::s_renderMutex;
-EmberCLns::RendererCL<EMBER_PRECISION> *EmberScene::s_renderer = 0;
+QMutex EmberScene::s_toolsMutex;
 EmberNs::SheepTools<EMBER_PRECISION, EMBER_PRECISION> *EmberScene::s_tools = 0;
 
-const unsigned int EmberScene::MAX_XFORMS = 5;
+const unsigned int EmberScene::DEFAULT_MAX_XFORMS = 5;
 
-const std::vector<EmberNs::eVariationId> &EmberScene::vars()
+std::vector<EmberNs::eVariationId> &EmberScene::vars()
 {
   static std::vector<EmberNs::eVariationId> vars;
   if ( vars.size() == 0 )
@@ -51,11 +61,12 @@ const std::vector<EmberNs::eVariationId> &EmberScene::vars()
   return vars;
 }
 
-EmberScene::EmberScene( int width, int height )
+EmberScene::EmberScene( int width, int height, unsigned int maxXforms, bool randomised )
   :AbstractScene()
 {
   m_width = width;
   m_height = height;
+  m_maxXforms = qMax( 1u, maxXforms );
 
   m_ember.m_OrigFinalRasW = width;
   m_ember.m_OrigFinalRasH = height;
@@ -65,7 +76,8 @@ EmberScene::EmberScene( int width, int height )
 
   m_ember.m_OrigPixPerUnit = 20;
 
-  randomise();
+  if ( randomised )
+    randomise();
 }
 
 EmberScene::EmberScene( const EmberScene &other )
@@ -73,6 +85,7 @@ EmberScene::EmberScene( const EmberScene &other )
 {
   m_width = other.m_width;
   m_height = other.m_height;
+  m_maxXforms = other.m_maxXforms;
 }
 
 AbstractScene *EmberScene::clone() const
@@ -87,11 +100,23 @@ EmberScene::~EmberScene()
 
 void EmberScene::randomise()
 {
+  // the distribution SheepTools picks xform counts from when left to itself, minus anything over the limit
+  static const unsigned int xformCounts[] = { 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 5, 5, 6 };
+  static const int xformCountsSize = sizeof( xformCounts ) / sizeof( xformCounts[0] );
+
+  int choices = 0;
+  while ( choices < xformCountsSize && xformCounts[choices] <= m_maxXforms )
+    ++ choices;
+  unsigned int xforms = choices ? xformCounts[ Randomiser::randomInt( choices ) ] : m_maxXforms;
+
+  TraceScope waiting( "tools wait" );
+  QMutexLocker locker( &s_toolsMutex );
+  waiting.end();
+
   if ( s_tools )
   {
-    do {
-      s_tools->Random( m_ember );
-    } while ( m_ember.XformCount() > MAX_XFORMS );
+    // no symmetry, as that adds xforms of its own
+    s_tools->Random( m_ember, vars(), false, xforms, 1 );
   }
   else
     throw EmberRendererNotInitialisedException();
@@ -105,20 +130,33 @@ void EmberScene::randomise()
 QPair< AbstractScene*, AbstractScene* > EmberScene::breed( AbstractScene *other, int mutationStrength )
 {
   // create two new scenes from this and one other, merging data from the two and
-  // mutating some parameters
+  // mutating some parameters. the children are crossed straight into, so there's no point randomising them first
 
-  EmberScene *left = new EmberScene( m_width, m_height );
-  EmberScene *right = new EmberScene( m_width, m_height );
+  EmberScene *left = new EmberScene( m_width, m_height, m_maxXforms, false );
+  EmberScene *right = new EmberScene( m_width, m_height, m_maxXforms, false );
 
   EmberScene *emberOther = dynamic_cast< EmberScene* > ( other );
 
-  do {
-    s_tools->Cross( this->m_ember, emberOther->m_ember, left->m_ember, CROSS_NOT_SPECIFIED );
-  } while ( left->m_ember.XformCount() > MAX_XFORMS );
+  // a union has every xform from both parents, so only allow it when that fits. interpolating and
+  // alternating keep to the larger parent's count, which is already within the limit
+  int crossMode = CROSS_NOT_SPECIFIED;
+  if ( m_ember.XformCount() + emberOther->m_ember.XformCount() > m_maxXforms )
+    crossMode = Randomiser::randomInt( 2 ) ? CROSS_INTERPOLATE : CROSS_ALTERNATE;
+
+  {
+    TraceScope waiting( "tools wait" );
+    QMutexLocker locker( &s_toolsMutex );
+    waiting.end();
+
+    if ( ! s_tools )
+      throw EmberRendererNotInitialisedException();
+
+    s_tools->Cross( this->m_ember, emberOther->m_ember, left->m_ember, crossMode );
+    s_tools->Cross( emberOther->m_ember, this->m_ember, right->m_ember, crossMode );
+  }
 
-  do {
-    s_tools->Cross( emberOther->m_ember, this->m_ember, right->m_ember, CROSS_NOT_SPECIFIED );
-  } while ( right->m_ember.XformCount() > MAX_XFORMS );
+  left->trimXforms();
+  right->trimXforms();
 
   left->mutate( mutationStrength );
   right->mutate( mutationStrength );
@@ -128,18 +166,55 @@ QPair< AbstractScene*, AbstractScene* > EmberScene::breed( AbstractScene *other,
 
 void EmberScene::mutateOnce()
 {
-  Ember<EMBER_PRECISION> mutated( m_ember );
-  std::vector<EmberNs::eVariationId> vars(this->vars());
+  int sym = 0;
+  EmberNs::eMutateMode mode = pickMutation( sym );
 
-  if ( s_tools )
-    s_tools->Mutate( mutated, MUTATE_NOT_SPECIFIED, vars, 0, 0.1 );
-  else
-    throw EmberRendererNotInitialisedException();
+  {
+    TraceScope waiting( "tools wait" );
+    QMutexLocker locker( &s_toolsMutex );
+    waiting.end();
 
-  if ( mutated.XformCount() > MAX_XFORMS )
-    mutateOnce();
-  else
-    m_ember = mutated;
+    if ( ! s_tools )
+      throw EmberRendererNotInitialisedException();
+
+    // every mode pickMutation allows keeps within the limit, so mutate in place rather than on a copy
+    s_tools->Mutate( m_ember, mode, vars(), sym, 0.1 );
+  }
+
+  trimXforms();
+}
+
+EmberNs::eMutateMode EmberScene::pickMutation( int &sym ) const
+{
+  unsigned int xforms = m_ember.XformCount();
+
+  EmberNs::eMutateMode modes[7];
+  int count = 0;
+  modes[count++] = MUTATE_ALL_VARIATIONS;
+  modes[count++] = MUTATE_ONE_XFORM_COEFS;
+  modes[count++] = MUTATE_POST_XFORMS;
+  modes[count++] = MUTATE_COLOR_PALETTE;
+  modes[count++] = MUTATE_ALL_COEFS;
+  // deletion needs something left over, and symmetry needs room for another xform
+  if ( xforms > 1 )
+    modes[count++] = MUTATE_DELETE_XFORM;
+  if ( xforms < m_maxXforms )
+    modes[count++] = MUTATE_ADD_SYMMETRY;
+
+  EmberNs::eMutateMode mode = modes[ Randomiser::randomInt( count ) ];
+
+  // n-fold rotational symmetry adds n - 1 xforms, so pick an order that fits
+  if ( mode == MUTATE_ADD_SYMMETRY )
+    sym = 2 + Randomiser::randomInt( m_maxXforms - xforms );
+
+  return mode;
+}
+
+void EmberScene::trimXforms()
+{
+  // only a backstop: the operators above are chosen to stay within the limit
+  while ( m_ember.XformCount() > m_maxXforms )
+    m_ember.DeleteXform( m_ember.XformCount() - 1 );
 }
 
 void EmberScene::saveToFile( const QString &fn )
@@ -192,62 +267,166 @@ void EmberScene::loadFromStream( QDataStream &stream )
 
 bool EmberScene::renderTo( QImage &image )
 {
-  bool failed = true;
+  m_ember.m_Quality = 50;
+
+  bool failed = ! render( m_ember, m_width, m_height, image );
+
+  // blanked where it is, so a caller's buffer keeps its format and alignment for the retry
+  if ( failed )
+    image.fill( Qt::black );
+
+  return !failed;
+}
+
+bool EmberScene::renderPreviewTo( QImage &image, int divisor, int quality )
+{
+  // same framing at a fraction of the size. fewer pixels means far fewer samples at the same quality,
+  // and the lower quality cuts the samples per pixel on top of that
+  EmberNs::Ember<EMBER_PRECISION> preview( m_ember );
+  preview.m_FinalRasW = m_width / divisor;
+  preview.m_FinalRasH = m_height / divisor;
+  preview.m_PixelsPerUnit = m_ember.m_PixelsPerUnit / divisor;
+  preview.m_Quality = quality;
+
+  return render( preview, preview.m_FinalRasW, preview.m_FinalRasH, image );
+}
+
+bool EmberScene::render( EmberNs::Ember<EMBER_PRECISION> &ember, int width, int height, QImage &image )
+{
+  bool rendered = false;
 
-  if ( s_renderer )
+  PooledRenderer *pooled = checkOutRenderer();
+  if ( ! pooled )
+    throw EmberRendererNotInitialisedException();
+
+  // Run() only returns once the render has finished, so there's nothing to wait for afterwards
+  TraceScope rendering( "flame render" );
+  pooled->renderer->SetEmber( ember );
+  if ( pooled->renderer->Run( pooled->buffer ) == RENDER_OK )
   {
-    s_renderMutex.lock();
+    copyToImage( pooled->buffer, width, height, image );
+    rendered = true;
+  }
+  rendering.end();
 
-    std::vector<byte> imgBytes( m_width * m_height * 4, 0xff0000ff );
+  checkInRenderer( pooled );
 
-    m_ember.m_Quality = 50;
+  return rendered;
+}
 
-    s_renderer->SetEmber( m_ember );
-    if ( s_renderer->Run( imgBytes ) == RENDER_OK )
+void EmberScene::copyToImage( const std::vector<byte> &rgba, int width, int height, QImage &image )
+{
+  // the engine may be evaluating in a reduced format, in which case the render goes straight into that
+  QImage::Format format = image.format();
+  if ( format != QImage::Format_Grayscale8 && format != QImage::Format_RGB16 )
+    format = QImage::Format_RGB32;
+  if ( image.width() != width || image.height() != height || image.format() != format )
+    image = QImage( width, height, format );
+
+  // ember writes r, g, b, a bytes
+  const byte *src = rgba.data();
+  for ( int y = 0; y < height; ++ y )
+  {
+    if ( format == QImage::Format_Grayscale8 )
     {
-      // I don't know if this is async or not, but treating it as such
-      while ( s_renderer->ProcessState() != ACCUM_DONE )
-        usleep(50);
-
-      failed = false;
+      uchar *dst = image.scanLine( y );
+      for ( int x = 0; x < width; ++ x, src += 4 )
+        dst[x] = qGray( src[0], src[1], src[2] );
+    }
+    else if ( format == QImage::Format_RGB16 )
+    {
+      quint16 *dst = reinterpret_cast< quint16* > ( image.scanLine( y ) );
+      for ( int x = 0; x < width; ++ x, src += 4 )
+        dst[x] = ( ( src[0] >> 3 ) << 11 ) | ( ( src[1] >> 2 ) << 5 ) | ( src[2] >> 3 );
     }
+    else
+    {
+      // qt wants native-endian 0xffrrggbb words
+      QRgb *dst = reinterpret_cast< QRgb* > ( image.scanLine( y ) );
+      for ( int x = 0; x < width; ++ x, src += 4 )
+        dst[x] = qRgb( src[0], src[1], src[2] );
+    }
+  }
+}
 
-    s_renderMutex.unlock();
+EmberScene::PooledRenderer *EmberScene::checkOutRenderer()
+{
+  // covers waiting for the lock and for a renderer to come back
+  TraceScope waiting( "renderer wait" );
+  QMutexLocker locker( &s_poolMutex );
+
+  if ( ! s_tools )
+    return 0;
 
-    if ( failed )
+  while ( s_idleRenderers.isEmpty() )
+  {
+    // cpu renderers are made on demand, so the pool only grows as big as the thread pool using it
+    if ( s_backend == CpuBackend && s_renderers.count() < s_maxRenderers )
     {
-      image = QImage( m_width, m_height, QImage::Format_ARGB32 );
-      image.fill( Qt::black );
-      qDebug( "Ember rendering failed" );
-    } else {
-      qDebug( "Ember rendering success" );
-      image = QImage( imgBytes.data(), m_width, m_height, QImage::Format_ARGB32 );
+      Renderer *renderer = new Renderer();
+      renderer->NumChannels( 4 );
+      // the parallelism comes from running one renderer per thread, not from inside each render
+      renderer->ThreadCount( 1 );
+      PooledRenderer *pooled = new PooledRenderer( renderer );
+      s_renderers.append( pooled );
+      return pooled;
     }
-  } else {
-    throw EmberRendererNotInitialisedException();
+
+    s_rendererReturned.wait( &s_poolMutex );
   }
 
-  return !failed;
+  return s_idleRenderers.takeLast();
+}
+
+void EmberScene::checkInRenderer( PooledRenderer *renderer )
+{
+  QMutexLocker locker( &s_poolMutex );
+
+  s_idleRenderers.append( renderer );
+  s_rendererReturned.wakeOne();
 }
 
 void EmberScene::destroyRenderer()
 {
-  // deleting tools deletes the renderer
-  if ( s_tools )
-    delete s_tools;
-  else
-    delete s_renderer;
+  QMutexLocker poolLocker( &s_poolMutex );
+  QMutexLocker toolsLocker( &s_toolsMutex );
 
-  s_renderer = 0;
+  // the opencl renderer belongs to the tools, and goes when they do. cpu renderers are all ours
+  foreach( PooledRenderer *pooled, s_renderers )
+  {
+    if ( s_backend == CpuBackend )
+      delete pooled->renderer;
+    delete pooled;
+  }
+  delete s_tools;
+
+  s_renderers.clear();
+  s_idleRenderers.clear();
   s_tools = 0;
 }
 
-bool EmberScene::initialiseRenderer( const QString &palettePath, int platform, int device )
+bool EmberScene::initialiseRenderer( const QString &palettePath, Backend backend, int platform, int device, int maxRenderers )
 {
   destroyRenderer();
 
-  s_renderer = new EmberCLns::RendererCL<EMBER_PRECISION>( platform, device );
-  s_tools = new EmberNs::SheepTools<EMBER_PRECISION, EMBER_PRECISION>( palettePath.toStdString(), s_renderer );
+  QMutexLocker poolLocker( &s_poolMutex );
+  QMutexLocker toolsLocker( &s_toolsMutex );
+
+  s_backend = backend;
+
+  if ( backend == OpenCLBackend )
+  {
+    EmberCLns::RendererCL<EMBER_PRECISION> *renderer = new EmberCLns::RendererCL<EMBER_PRECISION>( platform, device );
+    PooledRenderer *pooled = new PooledRenderer( renderer );
+    s_renderers.append( pooled );
+    s_idleRenderers.append( pooled );
+    s_maxRenderers = 1;
+    s_tools = new EmberNs::SheepTools<EMBER_PRECISION, EMBER_PRECISION>( palettePath.toStdString(), renderer );
+  } else {
+    s_maxRenderers = maxRenderers > 0 ? maxRenderers : QThread::idealThreadCount();
+    // the tools want a renderer of their own, though breeding never renders anything
+    s_tools = new EmberNs::SheepTools<EMBER_PRECISION, EMBER_PRECISION>( palettePath.toStdString(), new Renderer() );
+  }
 
   return true;
 }
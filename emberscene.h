@@ -11,6 +11,8 @@
 #include "x11_undefs.h"
 
 #include <QMutex>
+#include <QWaitCondition>
+#include <QList>
 #include <QException>
 
 #define EMBER_PRECISION float
@@ -25,18 +27,38 @@ public:
 class EmberScene : public AbstractScene
 {
 public:
-  EmberScene( int width, int height );
+  /// where flames get rendered
+  enum Backend
+  {
+    /// a single OpenCL renderer, which every thread takes turns on
+    OpenCLBackend,
+    /// one CPU renderer per thread, so renders run in parallel without a gpu
+    CpuBackend
+  };
+
+  /// the xform limit used when none is given
+  static const unsigned int DEFAULT_MAX_XFORMS;
+
+  /// creates a scene with at most maxXforms xforms. if randomised is false the scene is left empty,
+  /// for scenes that are about to be loaded or bred into
+  EmberScene( int width, int height, unsigned int maxXforms = DEFAULT_MAX_XFORMS, bool randomised = true );
   EmberScene( const EmberScene &other );
   virtual ~EmberScene();
 
-  static bool initialiseRenderer( const QString &palettePath, int platform, int device );
+  /// sets up the renderers. platform and device only matter for the OpenCL backend. maxRenderers caps
+  /// the number of CPU renderers, and defaults to one per core
+  static bool initialiseRenderer( const QString &palettePath, Backend backend, int platform, int device, int maxRenderers = 0 );
   static void destroyRenderer();
+  /// true if a renderer has been set up and not yet destroyed
+  static bool isRendererInitialised() { return s_tools != 0; }
 
   /// cross-breeds this scene with another one
   virtual QPair< AbstractScene*, AbstractScene* > breed( AbstractScene *other, int mutationStrength );
 
   // rendering methods
   virtual bool renderTo( QImage &image );
+  virtual bool renderPreviewTo( QImage &image, int divisor, int quality );
+  virtual bool rendersPreviews() const { return true; }
   virtual void saveToFile( const QString &fn );
 
   virtual void randomise();
@@ -53,18 +75,54 @@ protected:
   virtual void mutateOnce();
 
 private:
-  static const unsigned int MAX_XFORMS;
-
-  static QMutex s_renderMutex;
-  static EmberCLns::RendererCL<EMBER_PRECISION> *s_renderer;
+  typedef EmberNs::Renderer<EMBER_PRECISION, EMBER_PRECISION> Renderer;
+
+  /// a renderer plus the buffer it renders into, which is kept between renders so it isn't reallocated every time
+  struct PooledRenderer
+  {
+    explicit PooledRenderer( Renderer *r ) : renderer( r ) {}
+    Renderer *renderer;
+    std::vector<byte> buffer;
+  };
+
+  /// takes a renderer out of the pool, creating one or waiting for one to come back if none are idle
+  static PooledRenderer *checkOutRenderer();
+  /// returns a renderer to the pool
+  static void checkInRenderer( PooledRenderer *renderer );
+  /// renders an ember on a pooled renderer. returns false if the render failed
+  static bool render( EmberNs::Ember<EMBER_PRECISION> &ember, int width, int height, QImage &image );
+  /// copies ember's rgba output into image, reusing the image's buffer if it's the right size. keeps
+  /// the image's format if it's one of the reduced evaluation formats, otherwise makes it RGB32
+  static void copyToImage( const std::vector<byte> &rgba, int width, int height, QImage &image );
+
+  /// guards the renderer pool
+  static QMutex s_poolMutex;
+  static QWaitCondition s_rendererReturned;
+  static Backend s_backend;
+  /// renderers not currently in use
+  static QList< PooledRenderer* > s_idleRenderers;
+  /// every renderer in the pool, idle or not
+  static QList< PooledRenderer* > s_renderers;
+  static int s_maxRenderers;
+
+  /// SheepTools keeps its own random state, so breeding and mutation take turns on it
+  static QMutex s_toolsMutex;
   static EmberNs::SheepTools<EMBER_PRECISION, EMBER_PRECISION> *s_tools;
 
   int m_width;
   int m_height;
+  unsigned int m_maxXforms;
 
   EmberNs::Ember<EMBER_PRECISION> m_ember;
 
-  static const std::vector<EmberNs::eVariationId> &vars();
+  /// picks a mutation that can't take the scene over its xform limit. sym is set for symmetry mutations
+  EmberNs::eMutateMode pickMutation( int &sym ) const;
+  /// removes xforms from the end until the scene is within its limit
+  void trimXforms();
+
+  /// variations that mutation is allowed to use. only touched with s_toolsMutex held, since
+  /// SheepTools wants a non-const vector
+  static std::vector<EmberNs::eVariationId> &vars();
 };
 
 #endif // EMBERSCENE_H
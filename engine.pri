@@ -0,0 +1,64 @@
+# the evolution engine, shared by the dialog and the command-line driver.
+# nothing in here may depend on QtWidgets, or on the libraries behind any
+# scene type plugin (Fractorium, OpenCL)
+
+include(common.pri)
+
+QT       += core gui svg concurrent network
+
+# opencv, for the face detection
+macx {
+  INCLUDEPATH += /usr/local/Cellar/opencv/2.4.9/include/
+  LIBS += -L/usr/local/Cellar/opencv/2.4.9/lib/ -lopencv_core -lopencv_objdetect -lopencv_imgproc
+}
+
+linux-g++ {
+  LIBS += -lopencv_core -lopencv_objdetect -lopencv_imgproc
+}
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/facedetect.cpp \
+    $$PWD/poly.cpp \
+    $$PWD/randomiser.cpp \
+    $$PWD/trianglescene.cpp \
+    $$PWD/abstractscene.cpp \
+    $$PWD/faceweightedpixelsumfitness.cpp \
+    $$PWD/fitnesskernels.cpp \
+    $$PWD/fitnesscache.cpp \
+    $$PWD/selection.cpp \
+    $$PWD/evolutionparameters.cpp \
+    $$PWD/evolutionengine.cpp \
+    $$PWD/batchrunner.cpp \
+    $$PWD/pluginregistry.cpp \
+    $$PWD/scratchbuffer.cpp \
+    $$PWD/targetimage.cpp \
+    $$PWD/tracer.cpp \
+    $$PWD/metricsserver.cpp \
+    $$PWD/numatopology.cpp
+
+HEADERS += \
+    $$PWD/facedetect.h \
+    $$PWD/poly.h \
+    $$PWD/randomiser.h \
+    $$PWD/trianglescene.h \
+    $$PWD/abstractscene.h \
+    $$PWD/x11_undefs.h \
+    $$PWD/abstractfitness.h \
+    $$PWD/faceweightedpixelsumfitness.h \
+    $$PWD/fitnesskernels.h \
+    $$PWD/fitnesscache.h \
+    $$PWD/selection.h \
+    $$PWD/evolutionsnapshot.h \
+    $$PWD/evolutionparameters.h \
+    $$PWD/evolutionengine.h \
+    $$PWD/batchrunner.h \
+    $$PWD/sceneplugin.h \
+    $$PWD/pluginregistry.h \
+    $$PWD/scratchbuffer.h \
+    $$PWD/targetimage.h \
+    $$PWD/tracer.h \
+    $$PWD/metricsserver.h \
+    $$PWD/numatopology.h
@@ -0,0 +1,261 @@
+#include "evolutiondaemon.h"
+
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <QFileInfo>
+
+#include "evolutionsnapshot.h"
+#include "tracer.h"
+
+EvolutionDaemon::EvolutionDaemon( const EvolutionParameters &params, QThreadPool *pool, QObject *parent )
+  : QObject( parent )
+  , m_params( params )
+  , m_runner( params, pool )
+{
+  // the whole point is to stay warm between jobs, so don't let idle pool threads exit
+  pool->setExpiryTimeout( -1 );
+
+  m_runner.setKeepResults( true );
+  m_runner.start();
+
+  connect( &m_server, SIGNAL( newConnection() ), this, SLOT( newConnection() ) );
+
+  m_progressTimer.setInterval( 200 );
+  connect( &m_progressTimer, SIGNAL( timeout() ), this, SLOT( sendProgress() ) );
+  m_progressTimer.start();
+
+  m_traceTimer.setSingleShot( true );
+  connect( &m_traceTimer, SIGNAL( timeout() ), this, SLOT( finishTrace() ) );
+}
+
+EvolutionDaemon::~EvolutionDaemon()
+{
+  m_server.close();
+}
+
+bool EvolutionDaemon::listen( const QString &name )
+{
+  QLocalServer::removeServer( name );
+  return m_server.listen( name );
+}
+
+void EvolutionDaemon::shutdown()
+{
+  m_server.close();
+  m_runner.stop();
+  m_runner.waitForDone();
+
+  // let the clients hear how their jobs ended
+  sendProgress();
+
+  QCoreApplication::quit();
+}
+
+void EvolutionDaemon::newConnection()
+{
+  while( QLocalSocket *client = m_server.nextPendingConnection() )
+  {
+    connect( client, SIGNAL( readyRead() ), this, SLOT( readClient() ) );
+    connect( client, SIGNAL( disconnected() ), this, SLOT( clientDisconnected() ) );
+  }
+}
+
+void EvolutionDaemon::readClient()
+{
+  QLocalSocket *client = qobject_cast< QLocalSocket* >( sender() );
+  if ( ! client )
+    return;
+
+  while( client->canReadLine() )
+  {
+    QByteArray line( client->readLine().trimmed() );
+    if ( line.isEmpty() )
+      continue;
+
+    QJsonParseError error;
+    QJsonDocument doc( QJsonDocument::fromJson( line, &error ) );
+    if ( ! doc.isObject() )
+    {
+      QVariantMap reply;
+      reply.insert( "event", "error" );
+      reply.insert( "message", "Couldn't parse command: " + error.errorString() );
+      send( client, reply );
+      continue;
+    }
+
+    handleCommand( client, doc.object().toVariantMap() );
+  }
+}
+
+void EvolutionDaemon::clientDisconnected()
+{
+  QLocalSocket *client = qobject_cast< QLocalSocket* >( sender() );
+  if ( ! client )
+    return;
+
+  // the jobs carry on, there's just no-one to tell about them
+  for( QHash< int, QLocalSocket* >::iterator i = m_clients.begin(); i != m_clients.end(); ++ i )
+  {
+    if ( i.value() == client )
+      i.value() = 0;
+  }
+
+  client->deleteLater();
+}
+
+void EvolutionDaemon::handleCommand( QLocalSocket *client, const QVariantMap &command )
+{
+  QString name( command.value( "command" ).toString() );
+  QVariantMap reply;
+
+  if ( name == "submit" )
+  {
+    QString target( command.value( "target" ).toString() );
+    EvolutionParameters params( m_params );
+
+    if ( ! QFileInfo( target ).isReadable() )
+    {
+      reply.insert( "event", "error" );
+      reply.insert( "message", "Couldn't read target " + target );
+    } else if ( ! params.apply( command.value( "parameters" ).toMap() ) ) {
+      reply.insert( "event", "error" );
+      reply.insert( "message", QString( "Invalid parameters" ) );
+    } else {
+      int id = m_runner.addJob( target, command.value( "output" ).toString(), params );
+      m_clients.insert( id, client );
+      reply.insert( "event", "accepted" );
+      reply.insert( "job", id );
+    }
+  } else if ( name == "cancel" ) {
+    int id = command.value( "job" ).toInt();
+    if ( m_runner.cancel( id ) )
+    {
+      reply.insert( "event", "cancelling" );
+      reply.insert( "job", id );
+    } else {
+      reply.insert( "event", "error" );
+      reply.insert( "message", QString( "No such job %1" ).arg( id ) );
+    }
+  } else if ( name == "trace" ) {
+    // traces are short windows on a running daemon, so there's only ever one at a time
+    QString output( command.value( "output" ).toString() );
+    int seconds = command.value( "seconds", 10 ).toInt();
+    if ( m_traceTimer.isActive() )
+    {
+      reply.insert( "event", "error" );
+      reply.insert( "message", "Already writing a trace to " + m_tracePath );
+    } else if ( output.isEmpty() || seconds <= 0 ) {
+      reply.insert( "event", "error" );
+      reply.insert( "message", QString( "A trace needs an output file and a number of seconds" ) );
+    } else {
+      m_tracePath = output;
+      m_traceClient = client;
+      Tracer::instance().start();
+      m_traceTimer.start( seconds * 1000 );
+      reply.insert( "event", "tracing" );
+      reply.insert( "output", output );
+    }
+  } else {
+    reply.insert( "event", "error" );
+    reply.insert( "message", "Unknown command " + name );
+  }
+
+  send( client, reply );
+}
+
+void EvolutionDaemon::sendProgress()
+{
+  for( QHash< int, QLocalSocket* >::const_iterator i = m_clients.constBegin(); i != m_clients.constEnd(); ++ i )
+  {
+    EvolutionSnapshot *snapshot = m_runner.takeSnapshot( i.key() );
+    if ( ! snapshot )
+      continue;
+
+    if ( i.value() )
+    {
+      QVariantMap progress;
+      progress.insert( "event", "progress" );
+      progress.insert( "job", i.key() );
+      progress.insert( "generation", snapshot->totalGenerations );
+      progress.insert( "age", snapshot->age );
+      progress.insert( "culture", snapshot->culture );
+      progress.insert( "maxCultures", snapshot->maxCultures );
+      progress.insert( "currentFitness", snapshot->currentFitness );
+      progress.insert( "bestFitness", snapshot->bestFitness );
+      progress.insert( "iterationsPerSec", snapshot->iterationsPerSec );
+      progress.insert( "evaluationsPerSec", snapshot->evaluationsPerSec );
+      if ( snapshot->screening.screened )
+      {
+        progress.insert( "screened", snapshot->screening.screened );
+        progress.insert( "screenRejected", snapshot->screening.rejected );
+        progress.insert( "screenDisagreement", snapshot->screening.disagreementRate() );
+      }
+      if ( snapshot->phases.cacheLookups )
+        progress.insert( "cacheHitRate", snapshot->phases.cacheHitRate() );
+      send( i.value(), progress );
+
+      if ( ! snapshot->bestScene.isEmpty() && ( ! m_sentBest.contains( i.key() ) || m_sentBest.value( i.key() ) != snapshot->bestFitness ) )
+      {
+        QVariantMap best;
+        best.insert( "event", "best" );
+        best.insert( "job", i.key() );
+        best.insert( "fitness", snapshot->bestFitness );
+        best.insert( "scene", QString::fromLatin1( snapshot->bestScene.toBase64() ) );
+        send( i.value(), best );
+        m_sentBest.insert( i.key(), snapshot->bestFitness );
+      }
+    }
+
+    delete snapshot;
+  }
+
+  foreach( BatchRunner::Result result, m_runner.takeResults() )
+  {
+    QLocalSocket *client = m_clients.take( result.id );
+    m_sentBest.remove( result.id );
+
+    if ( ! client )
+      continue;
+
+    QVariantMap finished;
+    finished.insert( "event", "finished" );
+    finished.insert( "job", result.id );
+    finished.insert( "failed", result.failed );
+    if ( result.failed )
+      finished.insert( "error", result.error );
+    finished.insert( "reason", EvolutionEngine::stopReasonName( result.stopReason ) );
+    finished.insert( "bestFitness", result.bestFitness );
+    finished.insert( "generations", result.generations );
+    finished.insert( "activeTime", result.activeTime );
+    send( client, finished );
+  }
+}
+
+void EvolutionDaemon::finishTrace()
+{
+  Tracer::instance().stop();
+  bool written = Tracer::instance().write( m_tracePath );
+
+  if ( ! m_traceClient )
+    return;
+
+  QVariantMap reply;
+  if ( written )
+  {
+    reply.insert( "event", "traced" );
+    reply.insert( "output", m_tracePath );
+  } else {
+    reply.insert( "event", "error" );
+    reply.insert( "message", "Couldn't write the trace to " + m_tracePath );
+  }
+  send( m_traceClient, reply );
+}
+
+void EvolutionDaemon::send( QLocalSocket *client, const QVariantMap &message )
+{
+  client->write( QJsonDocument( QJsonObject::fromVariantMap( message ) ).toJson( QJsonDocument::Compact ) );
+  client->write( "\n" );
+}
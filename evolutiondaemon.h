@@ -0,0 +1,84 @@
+#ifndef EVOLUTIONDAEMON_H
+#define EVOLUTIONDAEMON_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QVariantMap>
+#include <QLocalServer>
+#include <QPointer>
+
+#include "evolutionparameters.h"
+#include "batchrunner.h"
+
+class QLocalSocket;
+class QThreadPool;
+
+/** Keeps a BatchRunner (and with it the thread pool and renderer) running between jobs, and takes
+    jobs from clients over a local socket. Messages are one JSON object per line.
+
+    Clients send:
+      {"command":"submit","target":"a.png","output":"dir","parameters":{"maxGenerations":1000,...}}
+      {"command":"cancel","job":3}
+      {"command":"trace","output":"trace.json","seconds":10}
+
+    and get back:
+      {"event":"accepted","job":3}           or {"event":"error","message":"..."}
+      {"event":"progress","job":3,...}       a few times a second while the job runs
+      {"event":"best","job":3,"fitness":..,"scene":"<base64>"}   when the best scene improves
+      {"event":"finished","job":3,"reason":"...",...}
+      {"event":"tracing","output":"trace.json"}   and then {"event":"traced","output":"trace.json"}
+
+    "parameters" uses the same keys as the ini file, and anything missing comes from the daemon's
+    own parameters. Jobs keep running if the client that submitted them goes away */
+
+class EvolutionDaemon : public QObject
+{
+  Q_OBJECT
+
+public:
+  EvolutionDaemon( const EvolutionParameters &params, QThreadPool *pool, QObject *parent = 0 );
+  virtual ~EvolutionDaemon();
+
+  /// starts listening on the named socket, replacing any stale socket left by a previous daemon
+  bool listen( const QString &name );
+  QString errorString() const { return m_server.errorString(); }
+
+  /// how often progress is sent to clients, in milliseconds
+  void setProgressInterval( int ms ) { m_progressTimer.setInterval( ms ); }
+  /// publishes every job's progress, and the depth of the queue, to a metrics server
+  void setMetricsServer( MetricsServer *metrics ) { m_runner.setMetricsServer( metrics ); }
+
+public slots:
+  /// cancels every job and quits the event loop once they have written their results
+  void shutdown();
+
+private slots:
+  void newConnection();
+  void readClient();
+  void clientDisconnected();
+  void sendProgress();
+  /// writes out the trace that a client asked for, once its time is up
+  void finishTrace();
+
+private:
+  void handleCommand( QLocalSocket *client, const QVariantMap &command );
+  void send( QLocalSocket *client, const QVariantMap &message );
+
+  EvolutionParameters m_params;
+  QLocalServer m_server;
+  BatchRunner m_runner;
+  QTimer m_progressTimer;
+
+  /// the client that submitted each job, or 0 once it has gone away
+  QHash< int, QLocalSocket* > m_clients;
+  /// best fitness last sent for each job, so "best" is only sent when it changes
+  QHash< int, float > m_sentBest;
+
+  /// the trace being recorded for a client, if there is one
+  QTimer m_traceTimer;
+  QString m_tracePath;
+  QPointer< QLocalSocket > m_traceClient;
+};
+
+#endif // EVOLUTIONDAEMON_H
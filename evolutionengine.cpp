@@ -0,0 +1,1359 @@
+#include "evolutionengine.h"
+
+#include "x11_undefs.h"
+
+#include <QtConcurrent>
+#include <QFuture>
+#include <QThreadPool>
+#include <QSet>
+#include <QHash>
+
+#include <algorithm>
+
+#include "abstractscene.h"
+#include "abstractfitness.h"
+#include "pluginregistry.h"
+#include "randomiser.h"
+#include "scratchbuffer.h"
+#include "tracer.h"
+#include "metricsserver.h"
+
+EvolutionEngine::EvolutionEngine( const TargetImage &target, const QString &logPath, const EvolutionParameters &params )
+  : m_params( params )
+  , m_target( target )
+  , m_logDir( logPath )
+  , m_fitnessCache( params.fitnessCacheSize )
+  , m_selection( params.selectionMethod, params.populationSize, params.tournamentSize )
+{
+  m_running = false;
+  m_initialised = false;
+  m_stopReason = NotStopped;
+  m_threadPool = QThreadPool::globalInstance();
+  m_sceneType = 0;
+  m_fitnessType = 0;
+  m_ownsSceneType = false;
+  m_publishBestScene = false;
+  m_metrics = 0;
+  m_totalGenerations = 0;
+  m_activeTime = 0;
+  m_fitness = 0;
+  m_previewFitness = 0;
+  m_evaluationFormat = EvolutionParameters::FullColourFormat;
+  m_tiled = false;
+  m_screening = false;
+  m_stripRows = 0;
+  m_scenesPerPass = MAX_SCENES_PER_PASS;
+  m_bestScene = 0;
+  m_cultureActive = false;
+  m_age = 0;
+  m_culture = 0;
+  m_maxCultures = 0;
+  m_rungPosition = 0;
+  m_rungBudget = 0;
+  m_rungTarget = 0;
+  m_iterations = 0;
+  m_maxIterations = 0;
+  m_acceptCount = 0;
+  m_improvements = 0;
+  m_plateauGenerations = 0;
+  m_iterationsPerSec = 0;
+  m_bestFitness = -1;
+  m_currentFitness = -1;
+}
+
+EvolutionEngine::~EvolutionEngine()
+{
+  if ( m_initialised )
+    finish();
+}
+
+bool EvolutionEngine::initialise()
+{
+  if ( m_initialised )
+  {
+    m_error = "The engine is already initialised";
+    return false;
+  }
+  if ( m_target.isNull() )
+  {
+    m_error = "Couldn't load the target image";
+    return false;
+  }
+
+  m_sceneType = PluginRegistry::instance().sceneType( m_params.sceneType );
+  m_fitnessType = PluginRegistry::instance().fitnessType( m_params.fitnessType );
+  if ( ! m_sceneType )
+  {
+    m_error = QString( "There's no scene type called \"%1\" in the plugin registry" ).arg( m_params.sceneType );
+    return false;
+  }
+  if ( ! m_fitnessType )
+  {
+    m_error = QString( "There's no fitness function called \"%1\" in the plugin registry" ).arg( m_params.fitnessType );
+    return false;
+  }
+
+  // only some scene types have a renderer to set up, so triangle runs never touch opencl. if something else
+  // has already set it up (such as the daemon, which keeps it warm between jobs) then it's theirs to shut down
+  if ( ! m_sceneType->isInitialised() )
+  {
+    if ( ! m_sceneType->initialise( m_params, m_threadPool ? m_threadPool->maxThreadCount() : 1 ) )
+    {
+      m_error = QString( "Couldn't initialise the %1 renderer" ).arg( m_sceneType->name() );
+      return false;
+    }
+    m_ownsSceneType = true;
+  }
+
+  // children are rendered whole unless that won't fit in the budget: each thread's scratch images for a
+  // pass, the two published candidates and the target itself. passes are shortened to fit if they can be
+  qint64 budget = qint64( m_params.memoryBudgetMB ) * 1024 * 1024;
+  qint64 imageBytes = qint64( m_target.bytesPerLine() ) * m_target.height();
+  int threads = m_threadPool ? m_threadPool->maxThreadCount() : 1;
+  m_scenesPerPass = MAX_SCENES_PER_PASS;
+  if ( budget > 0 && imageBytes > 0 )
+    m_scenesPerPass = int( qBound( qint64( MIN_SCENES_PER_PASS ), ( budget / imageBytes - 3 ) / threads, qint64( MAX_SCENES_PER_PASS ) ) );
+  m_tiled = m_target.isMapped() || ( budget > 0 && imageBytes * ( qint64( threads ) * m_scenesPerPass + 3 ) > budget );
+
+  // a scene of the type being evolved says what it can do
+  AbstractScene *probe = m_sceneType->createEmptyScene( m_params, m_target.width(), m_target.height() );
+  bool rendersBands = probe->rendersBands();
+  m_screening = probe->rendersPreviews();
+  delete probe;
+
+  if ( m_tiled )
+  {
+    if ( ! rendersBands )
+    {
+      m_error = QString( "%1 scenes can't be rendered in strips, so this target is too big for the memory budget" ).arg( m_sceneType->name() );
+      return false;
+    }
+  }
+
+  // initialise the candidates to the target, to match format and size. if tiled, they're shrunk to fit the display
+  QSize candidateSize( m_target.size() );
+  if ( m_tiled && ( candidateSize.width() > DISPLAY_SIZE || candidateSize.height() > DISPLAY_SIZE ) )
+    candidateSize.scale( DISPLAY_SIZE, DISPLAY_SIZE, Qt::KeepAspectRatio );
+  m_bestCandidate = m_target.scaled( candidateSize );
+  m_currentCandidate = m_bestCandidate;
+
+  QString logPath( m_logDir.absolutePath() );
+  removeDir( logPath );
+  if ( ! m_logDir.mkpath( logPath ) )
+  {
+    m_error = QString( "Couldn't create the log directory %1" ).arg( logPath );
+    return false;
+  }
+
+  m_bestScenesFile.setFileName( m_logDir.absoluteFilePath( "bestScenes.log" ) );
+  if ( ! m_bestScenesFile.open( QFile::WriteOnly | QFile::Truncate ) )
+  {
+    m_error = QString( "Couldn't write to the log directory %1: %2" ).arg( logPath, m_bestScenesFile.errorString() );
+    return false;
+  }
+  m_bestScenes.setDevice( &m_bestScenesFile );
+
+  m_profileFile.setFileName( m_logDir.absoluteFilePath( "profile.csv" ) );
+  m_profileFile.open( QFile::WriteOnly | QFile::Truncate | QFile::Text );
+  m_profile.setDevice( &m_profileFile );
+  m_profile << "generation,age,culture,activeMs,evaluations,evaluationsPerSec,allocations,cacheLookups,cacheHits";
+  for( int phase = 0; phase < PhaseStats::PhaseCount; ++ phase )
+    m_profile << "," << PhaseStats::phaseName( phase ) << "Ms";
+  m_profile << endl;
+  m_profileTimer.start();
+
+  m_runLogFile.setFileName( m_logDir.absoluteFilePath( "run.log" ) );
+  m_runLogFile.open( QFile::WriteOnly | QFile::Truncate | QFile::Text );
+  m_runLog.setDevice( &m_runLogFile );
+
+  createFitness( m_params.evaluationFormat );
+  if ( m_tiled && m_fitness->bandRows() <= 0 )
+  {
+    m_error = QString( "The %1 fitness function can't score strips, so this target is too big for the memory budget" ).arg( m_fitnessType->name() );
+    delete m_fitness;
+    m_fitness = 0;
+    delete m_previewFitness;
+    m_previewFitness = 0;
+    return false;
+  }
+
+  m_bestScene = m_sceneType->createEmptyScene( m_params, m_target.width(), m_target.height() );
+
+  m_logDir.remove( m_logDir.absoluteFilePath( "age." + QString::number( m_age ) + ".log" ) );
+
+  m_error.clear();
+  m_initialised = true;
+  m_running = true;
+
+  publishProgress();
+  m_publishTimer.start();
+
+  return true;
+}
+
+void EvolutionEngine::createFitness( EvolutionParameters::EvaluationFormat format )
+{
+  m_evaluationFormat = format;
+  QImage::Format imageFormat = EvolutionParameters::imageFormat( format );
+
+  // the target is converted once, and the children are rendered straight into the same format
+  m_fitness = m_fitnessType->createFitness( m_target.convertedTo( imageFormat ), m_params );
+  m_fitness->replicate();
+
+  if ( m_tiled && m_fitness->bandRows() > 0 )
+  {
+    // the strip buffers get half the budget between them, leaving the rest for the fitness function's
+    // own data and the pages of the target being read
+    int threads = m_threadPool ? m_threadPool->maxThreadCount() : 1;
+    int bandRows = m_fitness->bandRows();
+    qint64 stripBytes = qint64( m_params.memoryBudgetMB ) * 1024 * 1024 / 2 / threads;
+    m_stripRows = int( qBound( qint64( 1 ), stripBytes / m_fitness->target().bytesPerLine() / bandRows, qint64( m_target.height() / bandRows + 1 ) ) ) * bandRows;
+  }
+
+  // previews are compared against a target downsampled to the same size. that would be held whole in
+  // memory, outside the budget, so tiled runs don't screen at all. nor do scenes that can't preview, so
+  // they don't pay for a second target and face detection
+  int divisor = m_params.screenDivisor;
+  if ( m_screening && ! m_tiled && divisor > 1 && m_target.width() / divisor > 0 && m_target.height() / divisor > 0 )
+  {
+    QImage previewTarget( m_target.scaled( QSize( m_target.width() / divisor, m_target.height() / divisor ) ) );
+    m_previewFitness = m_fitnessType->createFitness( TargetImage( previewTarget, imageFormat ), m_params );
+    m_previewFitness->replicate();
+  }
+}
+
+void EvolutionEngine::switchEvaluationFormat( EvolutionParameters::EvaluationFormat format )
+{
+  delete m_fitness;
+  m_fitness = 0;
+  delete m_previewFitness;
+  m_previewFitness = 0;
+  m_fitnessCache.clear();
+
+  createFitness( format );
+  lap( PhaseStats::Fitness );
+
+  // scores in one format mean nothing in another, so everything carried forward is scored again
+  QList< AbstractScene* > scored( m_previousAge );
+  if ( m_bestFitness >= 0 )
+    scored << m_bestScene;
+  evaluateScenes( scored );
+
+  if ( m_bestFitness >= 0 )
+    m_bestFitness = m_bestScene->fitness();
+}
+
+void EvolutionEngine::run()
+{
+  // loop until we're told to stop
+  while( step() )
+    ;
+
+  finish();
+}
+
+void EvolutionEngine::stop()
+{
+  m_running = false;
+}
+
+QString EvolutionEngine::stopReasonName( StopReason reason )
+{
+  switch( reason )
+  {
+  case NotStopped:
+    return "running";
+  case StopRequested:
+    return "stopped";
+  case GenerationBudgetReached:
+    return "generation budget reached";
+  case TimeBudgetReached:
+    return "time budget reached";
+  case TargetFitnessReached:
+    return "target fitness reached";
+  case PlateauReached:
+    return "fitness plateaued";
+  default:
+    break;
+  }
+  return QString();
+}
+
+bool EvolutionEngine::step()
+{
+  if ( ! m_initialised || ! isRunning() )
+    return false;
+
+  QElapsedTimer stepTimer;
+  stepTimer.start();
+  m_lapTimer.start();
+
+  // each age simulates a number of cultures over a set number of iterations.
+  // at the start of every new age, the best cultures from the previous age are selected and merged into a smaller number
+  // of cultures by placing the best scene from each into a new scene pool
+
+  // one culture simulates one attempt to find the best fitness from a given starting point over a certain number of iterations
+  // each culture has a scene pool of a certaion size. for each iteration, the scene pool is mutated and scenes are cross-bred
+  // with each other. the scenes with the best fitness survive to the next iteration.
+
+  if ( ! m_cultureActive )
+    beginCulture();
+
+  runGeneration();
+  bool plateaued = hasPlateaued();
+
+  // run the loop for the current culture (or indefinitely for the last culture, unless it plateaus)
+  if ( m_maxIterations != 0 && m_iterations >= m_maxIterations )
+    endCulture();
+  else if ( plateaued )
+    endPlateau();
+
+  m_activeTime += stepTimer.elapsed();
+  checkBudget();
+
+  return isRunning();
+}
+
+void EvolutionEngine::lap( PhaseStats::Phase phase )
+{
+  qint64 elapsed = m_lapTimer.nsecsElapsed();
+  m_lapTimer.restart();
+  m_phaseStats.nsecs[phase] += elapsed;
+
+  // the phases are the engine thread's half of the timeline, with the workers' tasks alongside
+  Tracer &tracer( Tracer::instance() );
+  if ( tracer.isEnabled() )
+  {
+    qint64 now = tracer.now();
+    tracer.record( PhaseStats::phaseName( phase ), now - elapsed, now );
+  }
+}
+
+void EvolutionEngine::lapInterleaved()
+{
+  qint64 elapsed = m_lapTimer.nsecsElapsed();
+  m_lapTimer.restart();
+
+  Tracer &tracer( Tracer::instance() );
+  if ( tracer.isEnabled() )
+  {
+    qint64 now = tracer.now();
+    tracer.record( "rendering and fitness", now - elapsed, now );
+  }
+
+  qint64 render = m_interleavedRenderNsecs.fetchAndStoreRelaxed( 0 );
+  qint64 fitness = m_interleavedFitnessNsecs.fetchAndStoreRelaxed( 0 );
+  qint64 renderShare = render + fitness > 0 ? static_cast< qint64 > ( static_cast< double > ( elapsed ) * render / ( render + fitness ) ) : elapsed / 2;
+  m_phaseStats.nsecs[PhaseStats::Rendering] += renderShare;
+  m_phaseStats.nsecs[PhaseStats::Fitness] += elapsed - renderShare;
+  m_phaseStats.allocations += m_scratchAllocations.fetchAndStoreRelaxed( 0 );
+}
+
+void EvolutionEngine::writeProfile()
+{
+  // the counters are running totals, so the time between two rows is the difference between them
+  double evaluationsPerSec = m_activeTime > 0 ? m_phaseStats.evaluations * 1000.0 / m_activeTime : 0;
+  m_profile << m_totalGenerations << "," << m_age << "," << m_culture << "," << m_activeTime << ","
+            << m_phaseStats.evaluations << "," << evaluationsPerSec << "," << m_phaseStats.allocations << ","
+            << m_phaseStats.cacheLookups << "," << m_phaseStats.cacheHits;
+  for( int phase = 0; phase < PhaseStats::PhaseCount; ++ phase )
+    m_profile << "," << m_phaseStats.nsecs[phase] / 1000000.0;
+  m_profile << endl;
+
+  m_profileTimer.restart();
+}
+
+void EvolutionEngine::checkBudget()
+{
+  if ( m_params.maxGenerations > 0 && m_totalGenerations >= static_cast< quint64 > ( m_params.maxGenerations ) )
+    m_stopReason = GenerationBudgetReached;
+  else if ( m_params.maxSeconds > 0 && m_activeTime >= m_params.maxSeconds * 1000LL )
+    m_stopReason = TimeBudgetReached;
+  else if ( m_params.targetFitness >= 0 && m_bestFitness >= 0 && ! m_fitness->isBetterFitness( m_params.targetFitness, m_bestFitness ) )
+    m_stopReason = TargetFitnessReached;
+  else
+    return;
+
+  m_running = false;
+}
+
+bool EvolutionEngine::hasPlateaued()
+{
+  int window = m_params.plateauWindow;
+  if ( window <= 0 )
+    return false;
+
+  // the slot about to be overwritten holds the fitness from window generations ago
+  int slot = m_plateauGenerations % window;
+  float previous = m_plateauWindow[slot];
+  m_plateauWindow[slot] = m_currentFitness;
+  if ( ++ m_plateauGenerations <= window )
+    return false;
+
+  // fitness never gets worse within a culture, so the distance it's moved is the improvement
+  return qAbs( m_currentFitness - previous ) <= m_params.plateauThreshold * qAbs( previous );
+}
+
+void EvolutionEngine::endPlateau()
+{
+  m_runLog << "generation " << m_totalGenerations << ": age " << m_age << " culture " << m_culture
+           << " plateaued at fitness " << m_currentFitness << " after " << m_iterations << " generations" << endl;
+
+  // the last age has nothing after it, so a plateau there is the end of the run
+  if ( m_maxIterations == 0 )
+  {
+    m_stopReason = PlateauReached;
+    m_running = false;
+  } else {
+    endCulture();
+  }
+}
+
+void EvolutionEngine::beginCulture()
+{
+  // cheap formats get the early ages into the right area, and full colour finishes the job
+  if ( m_params.fullColourAge > 0 && m_age >= m_params.fullColourAge && m_evaluationFormat != EvolutionParameters::FullColourFormat )
+    switchEvaluationFormat( EvolutionParameters::FullColourFormat );
+
+  int populationSize = m_params.populationSize;
+
+  // the maximum number of cultures for the given age
+  m_maxCultures = 0;
+  // run many more iterations for future ages, as we hit diminishing returns
+  m_maxIterations = ( m_params.generationCount * ( 1 << m_age ) );
+
+  // run more cultures in earlier ages, so we can throw away the items with the lowest fitness more swiftly
+  for( int i = 0; i < m_params.maxAge - m_age; ++ i )
+  {
+    if ( m_maxCultures == 0 )
+      m_maxCultures = populationSize;
+    else
+      m_maxCultures *= 4;
+  }
+  if ( m_age == m_params.maxAge )
+    m_maxIterations = 0;
+
+  // a race runs its cultures a rung at a time, each only as far as the end of the rung
+  if ( isRacing() )
+  {
+    if ( m_rungCultures.isEmpty() )
+      beginRace();
+    m_culture = m_rungCultures[m_rungPosition];
+    m_maxIterations = m_rungTarget;
+  }
+  bool resuming = m_suspended.contains( m_culture );
+
+  // start by setting up the logs. a culture picking up where it left off carries on with its old log
+  m_cultureLogFile.setFileName( m_logDir.absoluteFilePath( "culture." + QString::number( m_age ) + "." + QString::number( m_culture ) + ".log" ) );
+  m_cultureLogFile.open( QFile::WriteOnly | ( resuming ? QFile::Append : QFile::Truncate ) );
+  m_cultureLog.setDevice( &m_cultureLogFile );
+
+  m_ageLogFile.setFileName( m_logDir.absoluteFilePath( "age." + QString::number( m_age ) + ".log" ) );
+  m_ageLogFile.open( QFile::WriteOnly | QFile::Append );
+  m_ageLog.setDevice( &m_ageLogFile );
+  lap( PhaseStats::Logging );
+
+  // set up the current pool
+  m_currentFitness = -1;
+  if ( resuming )
+  {
+    // the pool was scored before it was put aside
+    m_pool = m_suspended.value( m_culture ).pool;
+  } else if ( m_previousAge.isEmpty() )
+  {
+    // if there's no previous age, we're in the first age so initialise the pool with random values
+    for( int i = 0; i < populationSize; ++ i )
+      m_pool.append( createScene() );
+    m_phaseStats.allocations += populationSize;
+    lap( PhaseStats::Breeding );
+
+    evaluateScenes( m_pool );
+  } else {
+    // randomly take scenes from theprevious age to populate this one
+    for( int i = 0; i < populationSize; ++ i )
+    {
+      m_pool.append( m_previousAge[ Randomiser::randomInt( m_previousAge.count() ) ]->clone() );
+    }
+    m_phaseStats.allocations += populationSize;
+    lap( PhaseStats::Breeding );
+  }
+
+  // calculate the current and best fitness for this age, based on the new culture
+  for( int i = 0; i < populationSize; ++ i )
+  {
+    if ( m_fitness->isBetterFitness( m_pool[i]->fitness(), m_currentFitness ) || m_currentFitness < 0 )
+    {
+      m_currentFitness = m_pool[i]->fitness();
+
+      renderCandidate( m_pool[i], m_currentCandidate );
+    }
+    if ( m_fitness->isBetterFitness( m_pool[i]->fitness(), m_bestFitness ) || m_bestFitness < 0 )
+    {
+      m_bestFitness = m_pool[i]->fitness();
+
+      renderCandidate( m_pool[i], m_bestCandidate );
+    }
+  }
+
+  // update the display with our starting variables
+  publishProgress();
+  lap( PhaseStats::Publishing );
+
+  if ( resuming )
+  {
+    SuspendedCulture suspended( m_suspended.take( m_culture ) );
+    m_iterations = suspended.iterations;
+    m_acceptCount = suspended.acceptCount;
+    m_improvements = suspended.improvements;
+  } else {
+    m_iterations = 0;
+    m_acceptCount = 0;
+    m_improvements = 0;
+  }
+  m_plateauWindow.fill( 0, m_params.plateauWindow );
+  m_plateauGenerations = 0;
+
+  m_cultureTimer.start();
+  m_cultureActive = true;
+}
+
+void EvolutionEngine::runGeneration()
+{
+  bool logScenes = m_sceneType->logsScenes();
+
+  // shuffle the pool, and take the scenes in pairs...
+  for( int i = m_pool.count() - 1; i > 0; -- i )
+    m_pool.swap( i, Randomiser::randomInt( i + 1 ) );
+
+  QList< AbstractScene * > parents( m_pool );
+  QList< AbstractScene * > children;
+  m_pool.clear();
+  for( int i = 0; i + 1 < parents.count(); i += 2 )
+  {
+    // cross-breed and mutate the pair
+    QPair< AbstractScene*, AbstractScene* > pair = parents[i]->breed( parents[i + 1], m_params.mutationStrength );
+    children << pair.first << pair.second;
+  }
+  m_phaseStats.allocations += children.count();
+  lap( PhaseStats::Breeding );
+
+  // run the fitness function for the newly-generated children
+  evaluateChildren( children, parents );
+
+  // the next generation is picked from both parents and children, which are lined up with their
+  // fitness in one array, parents first. selection works on indices into it
+  QVector< AbstractScene * > gen2;
+  gen2.reserve( parents.count() + children.count() );
+  foreach( AbstractScene *scene, parents )
+    gen2 << scene;
+  foreach( AbstractScene *scene, children )
+    gen2 << scene;
+
+  // selection only compares floats, lower being better, so fitness that's better higher is negated
+  float sign = m_fitness->isBetterFitness( 0, 1 ) ? 1.0f : -1.0f;
+  m_selectionKeys.resize( gen2.count() );
+  for( int i = 0; i < gen2.count(); ++ i )
+    m_selectionKeys[i] = sign * gen2[i]->fitness();
+  m_selection.select( m_selectionKeys, m_survivors );
+  lap( PhaseStats::Sorting );
+
+  AbstractScene *best = gen2[m_survivors.first()];
+
+  // if the next generation has a better fitness than the current best fitness, update the candidate data
+  if ( m_fitness->isBetterFitness( best->fitness(), m_currentFitness ) )
+  {
+    ++ m_improvements;
+    m_currentFitness = best->fitness();
+    if ( logScenes )
+      best->saveToStream( m_cultureLog );
+    lap( PhaseStats::Logging );
+
+    renderCandidate( best, m_currentCandidate );
+    lap( PhaseStats::Publishing );
+
+    if ( m_fitness->isBetterFitness( m_currentFitness, m_bestFitness ) )
+    {
+      m_bestFitness = m_currentFitness;
+      delete m_bestScene;
+      m_bestScene = best->clone();
+      ++ m_phaseStats.allocations;
+      m_bestScenes << m_iterations;
+      m_bestScenes << m_currentFitness;
+      if ( logScenes )
+        m_bestScene->saveToStream( m_bestScenes );
+      lap( PhaseStats::Logging );
+
+      if ( m_publishBestScene )
+      {
+        QByteArray data;
+        QDataStream ds( &data, QIODevice::WriteOnly );
+        m_bestScene->saveToStream( ds );
+        m_bestSceneData = data;
+      }
+
+      m_bestCandidate = m_currentCandidate;
+      lap( PhaseStats::Publishing );
+    }
+  }
+
+  // populate the next pool with the survivors, the best first. anything else is finished with
+  for( int s = 0; s < m_survivors.count(); ++ s )
+  {
+    int i = m_survivors[s];
+    // children that got in on their own merits, rather than as the best
+    if ( s > 0 && i >= parents.count() )
+      ++ m_acceptCount;
+    m_pool.append( gen2[i] );
+    gen2[i] = 0;
+  }
+  qDeleteAll( gen2 );
+  lap( PhaseStats::Breeding );
+
+  ++ m_iterations;
+  ++ m_totalGenerations;
+
+  // timed in nanoseconds, so the rate is right from the first generation rather than after the first whole second
+  qint64 cultureNsecs = m_cultureTimer.nsecsElapsed();
+  m_iterationsPerSec = cultureNsecs > 0 ? static_cast< float > ( m_iterations * 1e9 / cultureNsecs ) : 0;
+
+  // let the display know how we're getting on, but no more often than it can redraw
+  if ( m_publishTimer.elapsed() >= 1000 / m_params.updatesPerSec )
+  {
+    publishProgress();
+    m_publishTimer.restart();
+  }
+  lap( PhaseStats::Publishing );
+
+  if ( m_profileTimer.elapsed() >= PROFILE_INTERVAL_MS )
+  {
+    writeProfile();
+    lap( PhaseStats::Logging );
+  }
+}
+
+void EvolutionEngine::evaluateChildren( const QList< AbstractScene* > &children, const QList< AbstractScene* > &parents )
+{
+  QList< QFuture< void > > futures;
+  QList< AbstractScene* > fullRenders;
+
+  // children that are copies of a scene already scored, or of each other, are only evaluated once
+  QList< QPair< AbstractScene*, AbstractScene* > > duplicates;
+  QList< AbstractScene* > unscored( reuseKnownFitness( children, duplicates ) );
+
+  if ( m_previewFitness )
+  {
+    // first pass: a cheap estimate for every child
+    foreach( AbstractScene *child, unscored )
+    {
+      if ( m_threadPool )
+        futures << QtConcurrent::run( m_threadPool, estimateFitnessForScene, m_previewFitness, m_params.screenDivisor, m_params.screenQuality, child );
+      else
+        estimateFitnessForScene( m_previewFitness, m_params.screenDivisor, m_params.screenQuality, child );
+    }
+    waitForAll( futures );
+    lap( PhaseStats::Screening );
+
+    // rank the parents and the estimated children together. nothing below the worst rank selection
+    // can pick will survive. children that took a known fitness count too, but copies waiting on
+    // another child's don't have one yet
+    QSet< AbstractScene* > copies;
+    for( int i = 0; i < duplicates.count(); ++ i )
+      copies << duplicates[i].first;
+    QVector< float > ranked;
+    foreach( AbstractScene *parent, parents )
+      ranked << parent->fitness();
+    foreach( AbstractScene *child, children )
+    {
+      if ( child->fitness() >= 0 && ! copies.contains( child ) )
+        ranked << child->fitness();
+    }
+    // only the cutoff itself is needed, not the order either side of it
+    int cutoffRank = m_selection.worstSurvivingRank( ranked.count() );
+    std::nth_element( ranked.begin(), ranked.begin() + cutoffRank, ranked.end(), [this]( float a, float b ) { return m_fitness->isBetterFitness( a, b ); } );
+    float cutoff = ranked.at( cutoffRank );
+
+    QHash< AbstractScene*, float > estimates;
+    foreach( AbstractScene *child, unscored )
+    {
+      float estimate = child->fitness();
+      if ( estimate < 0 )
+      {
+        // no preview, so it can only be judged on a full render
+        fullRenders << child;
+        continue;
+      }
+
+      ++ m_screeningStats.screened;
+      estimates.insert( child, estimate );
+
+      // previews are blurrier than the real thing, so give them the benefit of the doubt
+      if ( ! m_fitness->isBetterFitness( cutoff, estimate * ( 1.0f - m_params.screenMargin ) ) )
+      {
+        ++ m_screeningStats.confirmed;
+        fullRenders << child;
+      } else {
+        ++ m_screeningStats.rejected;
+        // rejected children keep their estimate as their fitness, which ranks them below the cutoff.
+        // a sample of them get rendered anyway, to see how often that was the wrong call
+        if ( m_params.screenAuditInterval > 0 && m_screeningStats.rejected % m_params.screenAuditInterval == 0 )
+        {
+          ++ m_screeningStats.audited;
+          fullRenders << child;
+        }
+      }
+    }
+
+    lap( PhaseStats::Screening );
+
+    // second pass: full renders for everything that might make the cut
+    evaluateScenes( fullRenders );
+
+    // see which screening decisions the full render disagreed with
+    for( QHash< AbstractScene*, float >::const_iterator i = estimates.constBegin(); i != estimates.constEnd(); ++ i )
+    {
+      if ( ! fullRenders.contains( i.key() ) )
+        continue;
+
+      bool passed = ! m_fitness->isBetterFitness( cutoff, i.value() * ( 1.0f - m_params.screenMargin ) );
+      bool madeTheCut = ! m_fitness->isBetterFitness( cutoff, i.key()->fitness() );
+      if ( passed && ! madeTheCut )
+        ++ m_screeningStats.falsePasses;
+      else if ( ! passed && madeTheCut )
+        ++ m_screeningStats.falseRejects;
+    }
+
+    // these scenes can't preview, so don't bother trying again
+    if ( estimates.isEmpty() && ! unscored.isEmpty() )
+    {
+      delete m_previewFitness;
+      m_previewFitness = 0;
+    }
+    lap( PhaseStats::Screening );
+  } else {
+    // no screening, so everything gets the full render
+    evaluateScenes( unscored );
+  }
+
+  for( int i = 0; i < duplicates.count(); ++ i )
+    duplicates[i].first->setFitness( duplicates[i].second->fitness() );
+}
+
+QList< AbstractScene* > EvolutionEngine::reuseKnownFitness( const QList< AbstractScene* > &scenes, QList< QPair< AbstractScene*, AbstractScene* > > &duplicates )
+{
+  if ( ! m_fitnessCache.isEnabled() )
+    return scenes;
+
+  QList< AbstractScene* > unscored;
+  QHash< quint64, AbstractScene* > firsts;
+  foreach( AbstractScene *scene, scenes )
+  {
+    quint64 hash = scene->hash();
+    if ( ! hash )
+    {
+      unscored << scene;
+      continue;
+    }
+
+    ++ m_phaseStats.cacheLookups;
+    float fitness;
+    if ( m_fitnessCache.find( hash, &fitness ) )
+    {
+      ++ m_phaseStats.cacheHits;
+      scene->setFitness( fitness );
+    } else if ( firsts.contains( hash ) ) {
+      ++ m_phaseStats.cacheHits;
+      duplicates << qMakePair( scene, firsts.value( hash ) );
+    } else {
+      firsts.insert( hash, scene );
+      unscored << scene;
+    }
+  }
+  return unscored;
+}
+
+void EvolutionEngine::evaluateScenes( const QList< AbstractScene* > &scenes )
+{
+  m_phaseStats.evaluations += scenes.count();
+  renderAndScoreScenes( scenes );
+
+  if ( m_fitnessCache.isEnabled() )
+  {
+    foreach( AbstractScene *scene, scenes )
+    {
+      quint64 hash = scene->hash();
+      if ( hash )
+        m_fitnessCache.insert( hash, scene->fitness() );
+    }
+  }
+}
+
+void EvolutionEngine::renderAndScoreScenes( const QList< AbstractScene* > &scenes )
+{
+  QList< QFuture< void > > futures;
+
+  if ( m_tiled )
+  {
+    evaluateScenesInStrips( scenes );
+    lapInterleaved();
+    return;
+  }
+
+  if ( shouldSplitImages( scenes ) )
+  {
+    evaluateScenesInBands( scenes );
+    lapInterleaved();
+    return;
+  }
+
+  // each pass streams the target once for all of its scenes, so passes are only made shorter than
+  // the most they can hold to spread a generation across the threads, and never shorter than a few
+  int threads = m_threadPool ? m_threadPool->maxThreadCount() : 1;
+  int perPass = qBound( MIN_SCENES_PER_PASS, ( scenes.count() + threads - 1 ) / threads, m_scenesPerPass );
+  for( int first = 0; first < scenes.count(); first += perPass )
+  {
+    if ( m_threadPool )
+      futures << QtConcurrent::run( m_threadPool, this, &EvolutionEngine::renderAndScorePass, scenes.mid( first, perPass ) );
+    else
+      renderAndScorePass( scenes.mid( first, perPass ) );
+  }
+  waitForAll( futures );
+  lapInterleaved();
+}
+
+void EvolutionEngine::waitForAll( QList< QFuture< void > > &futures )
+{
+  TraceScope trace( "wait" );
+
+  // wait for the fitness functions from this generation to complete
+  while( futures.count() )
+  {
+    while( futures.last().isRunning() )
+      futures.last().waitForFinished();
+    futures.takeLast();
+  }
+}
+
+void EvolutionEngine::endCulture()
+{
+  // we've completed all the iterations for the culture...
+
+  if ( isRacing() )
+  {
+    // ...or at least for this rung. put it aside in case it makes the next one
+    SuspendedCulture suspended;
+    suspended.pool = m_pool;
+    suspended.iterations = m_iterations;
+    suspended.acceptCount = m_acceptCount;
+    suspended.improvements = m_improvements;
+    m_suspended.insert( m_culture, suspended );
+    m_rungFitness.insert( m_culture, m_currentFitness );
+
+    m_pool.clear();
+    m_cultureActive = false;
+
+    // the cultures that drop out are written to the age log, so the rung has to end before it's closed
+    if ( ++ m_rungPosition == m_rungCultures.count() )
+      endRung();
+
+    m_cultureLogFile.close();
+    m_ageLogFile.close();
+  } else {
+    // write the best candidate to the age log, and place into the next age
+    if ( m_sceneType->logsScenes() )
+      m_pool.first()->saveToStream( m_ageLog );
+    m_nextAge.append( m_pool.takeFirst() );
+
+    m_cultureLogFile.close();
+    m_ageLogFile.close();
+
+    // clear the pool and advance to the next culture
+    qDeleteAll( m_pool );
+    m_pool.clear();
+    m_cultureActive = false;
+    ++ m_culture;
+
+    // if we've been through all the cultures, advance to the next age
+    if ( m_culture == m_maxCultures )
+      endAge();
+  }
+
+  writeProfile();
+  lap( PhaseStats::Logging );
+
+  publishProgress();
+  lap( PhaseStats::Publishing );
+}
+
+bool EvolutionEngine::isRacing() const
+{
+  // the last age runs its one culture for as long as the run lasts, so there's nothing to race
+  return m_params.cultureSchedule == EvolutionParameters::HalvingSchedule && m_age < m_params.maxAge && m_maxCultures > 1;
+}
+
+void EvolutionEngine::beginRace()
+{
+  // halving the field every rung takes this many rungs to get down to one culture, which then gets a rung to itself
+  int rungs = 1;
+  for( int n = m_maxCultures; n > 1; n = ( n + 1 ) / 2 )
+    ++ rungs;
+
+  // the race spends the same generations as running every culture to the end would, shared equally between the rungs
+  m_rungBudget = qint64( m_maxCultures ) * m_params.generationCount * ( 1 << m_age ) / rungs;
+
+  m_rungCultures.clear();
+  for( int culture = 0; culture < m_maxCultures; ++ culture )
+    m_rungCultures.append( culture );
+  m_rungPosition = 0;
+  m_rungTarget = int( qMax( qint64( 1 ), m_rungBudget / m_maxCultures ) );
+  m_rungFitness.clear();
+}
+
+void EvolutionEngine::endRung()
+{
+  // rank the cultures by how far they got, best first
+  QList< int > ranked( m_rungCultures );
+  std::stable_sort( ranked.begin(), ranked.end(), [this]( int a, int b ) {
+    return m_fitness->isBetterFitness( m_rungFitness.value( a ), m_rungFitness.value( b ) );
+  } );
+
+  // the better half carry on, unless there was only one left
+  int keep = ranked.count() > 1 ? ( ranked.count() + 1 ) / 2 : 0;
+  for( int i = keep; i < ranked.count(); ++ i )
+    retireCulture( ranked[i] );
+
+  m_rungCultures = ranked.mid( 0, keep );
+  m_rungPosition = 0;
+  m_rungFitness.clear();
+
+  if ( m_rungCultures.isEmpty() )
+  {
+    endAge();
+    return;
+  }
+
+  // the survivors share the next rung's generations between them
+  m_rungTarget += int( qMax( qint64( 1 ), m_rungBudget / keep ) );
+}
+
+void EvolutionEngine::retireCulture( int culture )
+{
+  SuspendedCulture suspended( m_suspended.take( culture ) );
+
+  // the pool is kept best first, so that's what goes on to the next age
+  if ( m_sceneType->logsScenes() )
+    suspended.pool.first()->saveToStream( m_ageLog );
+  m_nextAge.append( suspended.pool.takeFirst() );
+  qDeleteAll( suspended.pool );
+}
+
+void EvolutionEngine::endAge()
+{
+  qDeleteAll( m_previousAge );
+  m_previousAge = m_nextAge;
+  m_nextAge.clear();
+  m_culture = 0;
+  ++ m_age;
+  m_logDir.remove( m_logDir.absoluteFilePath( "age." + QString::number( m_age ) + ".log" ) );
+}
+
+void EvolutionEngine::finish()
+{
+  if ( ! m_initialised )
+    return;
+
+  if ( m_stopReason == NotStopped )
+    m_stopReason = StopRequested;
+  m_running = false;
+
+  // update the display
+  publishProgress();
+
+  // delete everyhing that's left
+  qDeleteAll( m_pool );
+  m_pool.clear();
+  for( QHash< int, SuspendedCulture >::iterator i = m_suspended.begin(); i != m_suspended.end(); ++ i )
+    qDeleteAll( i.value().pool );
+  m_suspended.clear();
+  m_rungCultures.clear();
+  qDeleteAll( m_nextAge );
+  m_nextAge.clear();
+  qDeleteAll( m_previousAge );
+  m_previousAge.clear();
+  m_cultureLogFile.close();
+  m_ageLogFile.close();
+
+  writeProfile();
+  m_profileFile.close();
+
+  m_runLog << "generation " << m_totalGenerations << ": stopped, " << stopReasonName( m_stopReason )
+           << ", best fitness " << m_bestFitness << endl;
+  m_runLogFile.close();
+
+  writeSvgs();
+
+  delete m_bestScene;
+  m_bestScene = 0;
+  delete m_fitness;
+  m_fitness = 0;
+  delete m_previewFitness;
+  m_previewFitness = 0;
+
+  if ( m_ownsSceneType )
+    m_sceneType->shutdown();
+  m_ownsSceneType = false;
+
+  if ( m_metrics )
+    m_metrics->remove( m_metricsRun );
+
+  m_initialised = false;
+}
+
+void EvolutionEngine::writeSvgs()
+{
+  // save the best scene to an svg
+  m_bestScene->saveToFile( m_logDir.absoluteFilePath( "bestPicture.svg" ) );
+
+  // iterate over the best scenes file, so that we can see the history of all improvements
+  m_bestScenesFile.close();
+  m_bestScenesFile.open( QFile::ReadOnly );
+  QDataStream bestScenesLoader( &m_bestScenesFile );
+  m_logDir.mkdir( "bestScenes" );
+  QDir bsDir( m_logDir.absoluteFilePath( "bestScenes" ) );
+  int count = 0;
+  while( ! bestScenesLoader.atEnd() )
+  {
+    int iteration;
+    float fitness;
+    bestScenesLoader >> iteration;
+    bestScenesLoader >> fitness;
+    QString bsFilePath = bsDir.absoluteFilePath( QString( "%1.%2.svg" ).arg( count, 7, 10, QLatin1Char( '0' ) ).arg( iteration ) );
+
+    if ( m_sceneType->logsScenes() )
+    {
+      AbstractScene *s = createScene();
+      s->loadFromStream( bestScenesLoader );
+      s->saveToFile( bsFilePath );
+      delete s;
+    }
+
+    ++ count;
+  }
+  m_bestScenesFile.close();
+
+  // write out the best svgs for each individual culture
+  QStringList filters;
+  filters.append( "age.*.log" );
+  //filters.append( "culture.*.log" );
+  foreach( QString logEntry, m_logDir.entryList( filters ) )
+  {
+    m_logDir.mkdir( logEntry + ".d" );
+    QDir entryDir( m_logDir.absoluteFilePath( logEntry + ".d" ) );
+    QFile lf( m_logDir.absoluteFilePath( logEntry ) );
+    lf.open( QFile::ReadOnly );
+    QDataStream d( &lf );
+    count = 0;
+    while( !d.atEnd() )
+    {
+      QString fp = entryDir.absoluteFilePath( QString( "%1.svg" ).arg( count, 7, 10, QLatin1Char( '0' ) ) );
+      AbstractScene *s = createScene();
+      s->loadFromStream( d );
+      s->saveToFile( fp );
+      delete s;
+
+      ++ count;
+    }
+  }
+}
+
+AbstractScene *EvolutionEngine::createScene() const
+{
+  return m_sceneType->createScene( m_params, m_target.width(), m_target.height() );
+}
+
+void EvolutionEngine::publishProgress()
+{
+  EvolutionSnapshot *snapshot = new EvolutionSnapshot;
+  snapshot->iterations = m_iterations;
+  snapshot->acceptCount = m_acceptCount;
+  snapshot->improvements = m_improvements;
+  snapshot->age = m_age;
+  snapshot->culture = m_culture;
+  snapshot->maxCultures = m_maxCultures;
+  snapshot->maxIterations = m_maxIterations;
+  snapshot->iterationsPerSec = m_iterationsPerSec;
+  snapshot->totalGenerations = m_totalGenerations;
+  snapshot->evaluationsPerSec = m_activeTime > 0 ? static_cast< float > ( m_phaseStats.evaluations * 1000.0 / m_activeTime ) : 0;
+  snapshot->bestFitness = m_bestFitness;
+  snapshot->currentFitness = m_currentFitness;
+  snapshot->screening = m_screeningStats;
+  snapshot->phases = m_phaseStats;
+  // these are implicitly shared, so the copy is deferred until the engine next draws into them
+  snapshot->bestCandidate = m_bestCandidate;
+  snapshot->currentCandidate = m_currentCandidate;
+  snapshot->bestScene = m_bestSceneData;
+
+  if ( m_metrics )
+    m_metrics->publish( m_metricsRun, *snapshot );
+  m_snapshots.publish( snapshot );
+}
+
+bool EvolutionEngine::shouldSplitImages( const QList< AbstractScene* > &scenes ) const
+{
+  if ( ! m_threadPool || scenes.isEmpty() || m_fitness->bandRows() <= 0 )
+    return false;
+
+  const TargetImage &target = m_fitness->target();
+  if ( scenes.count() >= m_threadPool->maxThreadCount() || target.width() * target.height() < MIN_SPLIT_PIXELS )
+    return false;
+
+  foreach( AbstractScene *scene, scenes )
+  {
+    if ( ! scene->rendersBands() )
+      return false;
+  }
+  return true;
+}
+
+void EvolutionEngine::evaluateScenesInBands( const QList< AbstractScene* > &scenes )
+{
+  int height = m_fitness->target().height();
+  int bandRows = m_fitness->bandRows();
+  int bandCount = ( height + bandRows - 1 ) / bandRows;
+
+  // a couple of pieces per thread evens out scenes that take longer to draw, and every piece is a
+  // whole number of the fitness' bands so it can score what it drew straight away
+  int pieces = qMin( bandCount, ( 2 * m_threadPool->maxThreadCount() + scenes.count() - 1 ) / scenes.count() );
+
+  // each piece is drawn into the buffer of whichever thread runs it, which is sized for the tallest
+  // piece so it's the same size every time
+  int pieceRows = qMin( height, ( bandCount + pieces - 1 ) / pieces * bandRows );
+
+  QVector< float > partials( scenes.count() * bandCount );
+  QList< QFuture< void > > futures;
+  for( int s = 0; s < scenes.count(); ++ s )
+  {
+    int firstBand = 0;
+    for( int piece = 0; piece < pieces; ++ piece )
+    {
+      int lastBand = bandCount * ( piece + 1 ) / pieces;
+      int top = firstBand * bandRows;
+      int bottom = qMin( height, lastBand * bandRows );
+      futures << QtConcurrent::run( m_threadPool, this, &EvolutionEngine::evaluateBand, scenes[s], top, bottom, pieceRows, partials.data() + s * bandCount + firstBand );
+      firstBand = lastBand;
+    }
+  }
+  waitForAll( futures );
+
+  // add the bands up in order, so the fitness is the same however the work was split
+  for( int s = 0; s < scenes.count(); ++ s )
+  {
+    float f = 0;
+    for( int b = 0; b < bandCount; ++ b )
+      f += partials[s * bandCount + b];
+    scenes[s]->setFitness( f );
+  }
+}
+
+void EvolutionEngine::evaluateScenesInStrips( const QList< AbstractScene* > &scenes )
+{
+  int height = m_target.height();
+  int bandRows = m_fitness->bandRows();
+  int bandCount = ( height + bandRows - 1 ) / bandRows;
+
+  // scenes are only split between threads when there aren't enough of them to go round
+  int threads = m_threadPool ? m_threadPool->maxThreadCount() : 1;
+  int pieces = qBound( 1, ( 2 * threads + scenes.count() - 1 ) / scenes.count(), bandCount );
+  if ( scenes.count() >= threads )
+    pieces = 1;
+
+  QVector< float > partials( scenes.count() * bandCount );
+  QList< QFuture< void > > futures;
+  for( int s = 0; s < scenes.count(); ++ s )
+  {
+    int firstBand = 0;
+    for( int piece = 0; piece < pieces; ++ piece )
+    {
+      int lastBand = bandCount * ( piece + 1 ) / pieces;
+      int top = firstBand * bandRows;
+      int bottom = qMin( height, lastBand * bandRows );
+      float *piecePartials = partials.data() + s * bandCount + firstBand;
+
+      if ( m_threadPool )
+        futures << QtConcurrent::run( m_threadPool, this, &EvolutionEngine::evaluateStrips, scenes[s], top, bottom, piecePartials );
+      else
+        evaluateStrips( scenes[s], top, bottom, piecePartials );
+
+      firstBand = lastBand;
+    }
+  }
+  waitForAll( futures );
+
+  // added up in order, the same as the whole-image evaluation would
+  for( int s = 0; s < scenes.count(); ++ s )
+  {
+    float f = 0;
+    for( int b = 0; b < bandCount; ++ b )
+      f += partials[s * bandCount + b];
+    scenes[s]->setFitness( f );
+  }
+}
+
+void EvolutionEngine::evaluateStrips( AbstractScene *scene, int top, int bottom, float *partials ) const
+{
+  int bandRows = m_fitness->bandRows();
+
+  // however big the target, each thread only ever draws into one strip-sized buffer
+  bool allocated = false;
+  QImage &buffer( ScratchBuffer::forThread( QSize( m_target.width(), m_stripRows ), m_fitness->target().format(), 0, &allocated ) );
+  if ( allocated )
+    m_scratchAllocations.ref();
+  Tracer &tracer( Tracer::instance() );
+  qint64 renderNsecs = 0;
+  qint64 fitnessNsecs = 0;
+  for( int stripTop = top; stripTop < bottom; stripTop += m_stripRows )
+  {
+    int rows = qMin( m_stripRows, bottom - stripTop );
+    QImage strip( buffer.bits(), buffer.width(), rows, buffer.bytesPerLine(), buffer.format() );
+    qint64 start = tracer.now();
+    scene->renderBandTo( strip, stripTop );
+    qint64 rendered = tracer.now();
+    m_fitness->getBandFitnesses( strip, stripTop, partials );
+    qint64 scored = tracer.now();
+    partials += ( rows + bandRows - 1 ) / bandRows;
+
+    renderNsecs += rendered - start;
+    fitnessNsecs += scored - rendered;
+    if ( tracer.isEnabled() )
+    {
+      tracer.record( "render strip", start, rendered );
+      tracer.record( "fitness strip", rendered, scored );
+    }
+  }
+
+  m_interleavedRenderNsecs.fetchAndAddRelaxed( renderNsecs );
+  m_interleavedFitnessNsecs.fetchAndAddRelaxed( fitnessNsecs );
+}
+
+void EvolutionEngine::evaluateBand( AbstractScene *scene, int top, int bottom, int bufferRows, float *partials ) const
+{
+  // the buffer is the thread's own, so its pages were first touched on the thread's node
+  const TargetImage &target = m_fitness->target();
+  bool allocated = false;
+  QImage &buffer( ScratchBuffer::forThread( QSize( target.width(), bufferRows ), target.format(), BAND_SLOT, &allocated ) );
+  if ( allocated )
+    m_scratchAllocations.ref();
+  QImage band( buffer.bits(), buffer.width(), bottom - top, buffer.bytesPerLine(), buffer.format() );
+
+  Tracer &tracer( Tracer::instance() );
+  qint64 start = tracer.now();
+  scene->renderBandTo( band, top );
+  qint64 rendered = tracer.now();
+  m_fitness->getBandFitnesses( band, top, partials );
+  qint64 scored = tracer.now();
+
+  m_interleavedRenderNsecs.fetchAndAddRelaxed( rendered - start );
+  m_interleavedFitnessNsecs.fetchAndAddRelaxed( scored - rendered );
+  if ( tracer.isEnabled() )
+  {
+    tracer.record( "render band", start, rendered );
+    tracer.record( "fitness band", rendered, scored );
+  }
+}
+
+void EvolutionEngine::renderCandidate( AbstractScene *scene, QImage &image ) const
+{
+  if ( m_tiled )
+    scene->renderScaledTo( image );
+  else
+    scene->renderTo( image );
+}
+
+void EvolutionEngine::renderScene( AbstractScene *scene, QImage *image )
+{
+  TraceScope trace( "render" );
+  while ( ! scene->renderTo( *image ) )
+    scene->randomise();
+}
+
+void EvolutionEngine::renderAndScorePass( QList< AbstractScene* > scenes ) const
+{
+  const TargetImage &target = m_fitness->target();
+
+  // the last slot is taken first, so the thread's list of scratch images has grown to its full size
+  // before any of the pointers into it are kept
+  QVector< QImage* > renders( scenes.count() );
+  int allocations = 0;
+  for( int i = scenes.count() - 1; i >= 0; -- i )
+  {
+    bool allocated = false;
+    renders[i] = &ScratchBuffer::forThread( target.size(), target.format(), PASS_SLOT + i, &allocated );
+    allocations += allocated ? 1 : 0;
+  }
+
+  // a new size means the thread has moved on to another target (as batch jobs share threads), so
+  // anything it kept past this pass's slots is the old size, and would only be allocated again
+  if ( allocations )
+  {
+    ScratchBuffer::releaseForThread( PASS_SLOT + scenes.count() );
+    m_scratchAllocations.fetchAndAddRelaxed( allocations );
+  }
+
+  Tracer &tracer( Tracer::instance() );
+  qint64 start = tracer.now();
+  QVector< const QImage* > images;
+  for( int i = 0; i < scenes.count(); ++ i )
+  {
+    renderScene( scenes[i], renders[i] );
+    images << renders[i];
+  }
+  qint64 rendered = tracer.now();
+
+  QVector< float > results;
+  m_fitness->getFitnesses( images, results );
+  for( int i = 0; i < scenes.count(); ++ i )
+    scenes[i]->setFitness( results[i] );
+  qint64 scored = tracer.now();
+
+  m_interleavedRenderNsecs.fetchAndAddRelaxed( rendered - start );
+  m_interleavedFitnessNsecs.fetchAndAddRelaxed( scored - rendered );
+  if ( tracer.isEnabled() )
+    tracer.record( "fitness", rendered, scored );
+}
+
+void EvolutionEngine::estimateFitnessForScene( const AbstractFitness *previewFitness, int divisor, int quality, AbstractScene *scene )
+{
+  TraceScope trace( "screen" );
+  QImage &preview( ScratchBuffer::forThread( previewFitness->target().size(), previewFitness->target().format(), 1 ) );
+  if ( ! scene->renderPreviewTo( preview, divisor, quality ) || preview.size() != previewFitness->target().size() )
+  {
+    scene->setFitness( -1 );
+    return;
+  }
+
+  // each preview pixel stands in for divisor * divisor pixels of the full render
+  scene->setFitness( previewFitness->getFitness( preview ) * divisor * divisor );
+}
+
+bool EvolutionEngine::removeDir(const QString &dirName)
+{
+  bool result = true;
+  QDir dir(dirName);
+
+  if (dir.exists(dirName)) {
+    Q_FOREACH(QFileInfo info, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::System | QDir::Hidden  | QDir::AllDirs | QDir::Files, QDir::DirsFirst)) {
+      if (info.isDir()) {
+        result = removeDir(info.absoluteFilePath());
+      }
+      else {
+        result = QFile::remove(info.absoluteFilePath());
+      }
+
+      if (!result) {
+        return result;
+      }
+    }
+    result = dir.rmdir(dirName);
+  }
+
+  return result;
+}
@@ -0,0 +1,313 @@
+#ifndef EVOLUTIONENGINE_H
+#define EVOLUTIONENGINE_H
+
+#include <QImage>
+#include <QList>
+#include <QHash>
+#include <QVector>
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QTextStream>
+#include <QFuture>
+
+#include "evolutionparameters.h"
+#include "evolutionsnapshot.h"
+#include "targetimage.h"
+#include "fitnesscache.h"
+#include "selection.h"
+
+class AbstractScene;
+class AbstractFitness;
+class SceneType;
+class FitnessType;
+class QThreadPool;
+class MetricsServer;
+
+/** Runs the genetic algorithm against a target image. Has no dependency on any widgets, so it can
+    be driven from the dialog or run headless. Progress is published to snapshots(), and the logs
+    and svgs are written to the log directory */
+
+class EvolutionEngine
+{
+public:
+  /// why the engine stopped running
+  enum StopReason { NotStopped, StopRequested, GenerationBudgetReached, TimeBudgetReached, TargetFitnessReached, PlateauReached };
+
+  EvolutionEngine( const TargetImage &target, const QString &logPath, const EvolutionParameters &params );
+  virtual ~EvolutionEngine();
+
+  /// sets up the scene type, fitness function and log directory. must succeed before anything is run.
+  /// fails if the scene or fitness type named in the parameters isn't in the plugin registry, and
+  /// errorString() then says why
+  bool initialise();
+  /// why initialise() failed
+  QString errorString() const { return m_error; }
+
+  /// runs generations until stop() is called, then writes out the results
+  void run();
+
+  /// runs a single generation, starting and ending cultures and ages as required.
+  /// returns false once the engine has been stopped, or has used up its budget
+  bool step();
+
+  /// writes the best scenes out as svgs, and releases everything. called by run()
+  void finish();
+
+  /// tells the engine to stop after the current generation. safe to call from any thread
+  void stop();
+  bool isRunning() const { return m_running.load() != 0; }
+  StopReason stopReason() const { return m_stopReason; }
+  static QString stopReasonName( StopReason reason );
+
+  /// sets the pool that children are evaluated on. defaults to the global pool. with no pool,
+  /// children are evaluated on the calling thread, for when many engines are already sharing a pool
+  void setThreadPool( QThreadPool *pool ) { m_threadPool = pool; }
+
+  /// generations run so far, across all cultures and ages
+  quint64 totalGenerations() const { return m_totalGenerations; }
+  /// scenes given a full render and score so far (screening previews aren't counted)
+  quint64 evaluations() const { return m_phaseStats.evaluations; }
+  /// milliseconds spent inside step() so far
+  qint64 activeTime() const { return m_activeTime; }
+  float bestFitness() const { return m_bestFitness; }
+  const ScreeningStats &screeningStats() const { return m_screeningStats; }
+  /// where the time inside step() has gone so far
+  const PhaseStats &phaseStats() const { return m_phaseStats; }
+
+  /// latest progress, for whoever is displaying it
+  SnapshotSlot &snapshots() { return m_snapshots; }
+  /// whether snapshots should include the serialised best scene. costs a saveToStream per improvement
+  void setPublishBestScene( bool publish ) { m_publishBestScene = publish; }
+  /// also publishes progress to a metrics server, labelled with run. the run is removed from it when the engine finishes
+  void setMetrics( MetricsServer *metrics, const QString &run ) { m_metrics = metrics; m_metricsRun = run; }
+
+  const EvolutionParameters &parameters() const { return m_params; }
+
+private:
+  /// sets up the pool and logs for the next culture
+  void beginCulture();
+  /// breeds, evaluates and selects one generation of the current culture
+  void runGeneration();
+  /// works out the fitness of a generation's children, screening them first if the scenes support it.
+  /// parents are the scenes that the children will compete with for selection
+  void evaluateChildren( const QList< AbstractScene* > &children, const QList< AbstractScene* > &parents );
+  /// gives scenes identical to one already scored its fitness. returns the scenes that still need
+  /// evaluating, with only the first of any identical scenes among them. the rest are added to
+  /// duplicates, paired with that first one, to copy its fitness once it has one
+  QList< AbstractScene* > reuseKnownFitness( const QList< AbstractScene* > &scenes, QList< QPair< AbstractScene*, AbstractScene* > > &duplicates );
+  /// fully evaluates scenes, and remembers their fitness in the cache
+  void evaluateScenes( const QList< AbstractScene* > &scenes );
+  /// renders and scores scenes in passes of a few at a time, spread across the pool
+  void renderAndScoreScenes( const QList< AbstractScene* > &scenes );
+  /// renders scenes into the calling thread's scratch images, then scores them all in one pass over the target
+  void renderAndScorePass( QList< AbstractScene* > scenes ) const;
+  /// true if there are too few scenes to keep the pool busy, and the images are big enough that
+  /// splitting each one across threads is worth it
+  bool shouldSplitImages( const QList< AbstractScene* > &scenes ) const;
+  /// creates the fitness functions that score children in a format
+  void createFitness( EvolutionParameters::EvaluationFormat format );
+  /// moves to scoring children in another format, and rescores everything that's carried forward
+  void switchEvaluationFormat( EvolutionParameters::EvaluationFormat format );
+  /// renders and scores every scene a few bands of rows at a time, spread across the pool
+  void evaluateScenesInBands( const QList< AbstractScene* > &scenes );
+  /// renders and scores every scene a strip at a time, for targets too big to render whole
+  void evaluateScenesInStrips( const QList< AbstractScene* > &scenes );
+  /// renders and scores the rows of a scene from top to bottom through the calling thread's strip
+  /// buffer, writing the partial fitness of each band
+  void evaluateStrips( AbstractScene *scene, int top, int bottom, float *partials ) const;
+  /// renders rows top to bottom of a scene into the calling thread's band buffer, which is bufferRows
+  /// high, and writes the partial fitness of each of their bands
+  void evaluateBand( AbstractScene *scene, int top, int bottom, int bufferRows, float *partials ) const;
+  /// draws a scene into one of the candidate images that are published for display
+  void renderCandidate( AbstractScene *scene, QImage &image ) const;
+  /// waits for every future in the list, and empties it
+  static void waitForAll( QList< QFuture< void > > &futures );
+  /// passes the best of the culture on to the next age, advancing the age if needed
+  void endCulture();
+  /// true if the current age's cultures are being raced by successive halving
+  bool isRacing() const;
+  /// sets up the first rung of a race between every culture of the age
+  void beginRace();
+  /// ranks the cultures that ran the rung that's just finished, retires the worse half, and sets up the
+  /// next rung for the rest. the last culture standing is retired after a rung of its own
+  void endRung();
+  /// passes a suspended culture's best scene on to the next age, and deletes the rest of its pool
+  void retireCulture( int culture );
+  /// moves on to the next age once every culture of this one has been retired
+  void endAge();
+
+  /// stops the run if any part of its budget has been used up
+  void checkBudget();
+  /// records the current fitness in the plateau window, and returns true if it's barely moved across it
+  bool hasPlateaued();
+  /// ends a culture that has plateaued, or the run if it's in the last age
+  void endPlateau();
+
+  /// charges the time since the last lap to a phase
+  void lap( PhaseStats::Phase phase );
+  /// charges the time since the last lap to rendering and fitness, for passes that do both at once.
+  /// it's split in the proportion the workers spent on each
+  void lapInterleaved();
+  /// appends the counters so far to profile.csv
+  void writeProfile();
+
+  /// creates a new, random scene of the type being evolved
+  AbstractScene *createScene() const;
+
+  /// publishes all progress variables for the display to pick up
+  void publishProgress();
+
+  /// converts a log of streamed scenes to a directory of svgs
+  void writeSvgs();
+
+  /// renders a scene into an image, re-rolling it until it renders
+  static void renderScene( AbstractScene *scene, QImage *image );
+  /// estimates the fitness of a scene from a preview render, and stores the estimate within the scene.
+  /// stores -1 if the scene can't render a preview
+  static void estimateFitnessForScene( const AbstractFitness *previewFitness, int divisor, int quality, AbstractScene *scene );
+
+  /// removes a directory, recursively
+  static bool removeDir( const QString &dirName );
+
+  EvolutionParameters m_params;
+  TargetImage m_target;
+  QDir m_logDir;
+
+  QAtomicInt m_running;
+  bool m_initialised;
+  StopReason m_stopReason;
+  QString m_error;
+
+  QThreadPool *m_threadPool;
+  /// the scene and fitness types named in the parameters, from the plugin registry
+  SceneType *m_sceneType;
+  FitnessType *m_fitnessType;
+  /// set if this engine initialised the scene type (such as starting the flame renderer), rather than finding it already running
+  bool m_ownsSceneType;
+  quint64 m_totalGenerations;
+  qint64 m_activeTime;
+
+  PhaseStats m_phaseStats;
+  /// started at the beginning of each step, and restarted by every lap
+  QElapsedTimer m_lapTimer;
+  /// time the workers spent drawing and scoring in passes that do both, until the next lap shares it out
+  mutable QAtomicInteger< qint64 > m_interleavedRenderNsecs;
+  mutable QAtomicInteger< qint64 > m_interleavedFitnessNsecs;
+  /// scratch images the workers had to allocate, until the next lap adds them to the allocation count
+  mutable QAtomicInt m_scratchAllocations;
+  QFile m_profileFile;
+  QTextStream m_profile;
+  QElapsedTimer m_profileTimer;
+  /// profile.csv gets a row at the end of every culture, and at least this often
+  static const int PROFILE_INTERVAL_MS = 10000;
+  /// run.log records plateaus and why the run stopped, one line each
+  QFile m_runLogFile;
+  QTextStream m_runLog;
+
+  AbstractFitness *m_fitness;
+  /// fitness against the downsampled target, for screening. 0 if not screening
+  AbstractFitness *m_previewFitness;
+  /// the format the fitness functions currently score in
+  EvolutionParameters::EvaluationFormat m_evaluationFormat;
+  ScreeningStats m_screeningStats;
+  /// fitness of recently evaluated scenes, by hash, in the current format
+  FitnessCache m_fitnessCache;
+  /// the fewest scenes scored in one pass over the target, even if that leaves threads idle, as every
+  /// pass streams the whole target through the cache
+  static const int MIN_SCENES_PER_PASS = 4;
+  /// the most, so the thread's scratch images stay few
+  static const int MAX_SCENES_PER_PASS = 8;
+  /// the most scenes a pass may hold within the memory budget, as every thread keeps an image for each
+  int m_scenesPerPass;
+  /// the scratch slot of each thread's band buffer. slot 0 holds the strip buffer and 1 the preview
+  static const int BAND_SLOT = 2;
+  /// the scratch slot of a pass's first image
+  static const int PASS_SLOT = 3;
+
+  /// images smaller than this are always evaluated whole
+  static const int MIN_SPLIT_PIXELS = 512 * 512;
+
+  /// set if the target is too big to render children whole within the memory budget, so they're
+  /// rendered a strip at a time, and the published candidates are drawn at display size
+  bool m_tiled;
+  /// set if the scene type can render previews, so children are screened before their full render
+  bool m_screening;
+  /// rows per strip, a whole number of the fitness' bands
+  int m_stripRows;
+  /// the most either side of a published candidate can be when tiled
+  static const int DISPLAY_SIZE = 1024;
+
+  /// picks each generation's survivors, from their fitness laid out in m_selectionKeys
+  Selection m_selection;
+  QVector< float > m_selectionKeys;
+  QVector< int > m_survivors;
+
+  // age and culture management
+  QList< AbstractScene* > m_previousAge;
+  QList< AbstractScene* > m_nextAge;
+  QList< AbstractScene* > m_pool;
+  bool m_cultureActive;
+  int m_age;
+  int m_culture;
+  int m_maxCultures;
+
+  /// a culture put aside at the end of a rung, to carry on if it makes the next one
+  struct SuspendedCulture
+  {
+    QList< AbstractScene* > pool;
+    int iterations;
+    quint64 acceptCount;
+    int improvements;
+  };
+
+  // successive halving. each rung runs every culture still in the race for a slice of generations
+  QHash< int, SuspendedCulture > m_suspended;
+  /// the cultures in the current rung, in the order they're run
+  QList< int > m_rungCultures;
+  /// how far through m_rungCultures the engine is
+  int m_rungPosition;
+  /// the generations every culture in the race is given a share of, per rung
+  qint64 m_rungBudget;
+  /// the total generations a culture will have run by the end of the current rung
+  int m_rungTarget;
+  /// the best fitness each culture reached in the current rung
+  QHash< int, float > m_rungFitness;
+
+  // progress within the current culture
+  int m_iterations;
+  int m_maxIterations;
+  quint64 m_acceptCount;
+  int m_improvements;
+  /// the culture's fitness over the last plateauWindow generations, as a ring
+  QVector< float > m_plateauWindow;
+  /// generations the culture has run since it began or resumed
+  int m_plateauGenerations;
+  float m_iterationsPerSec;
+  QElapsedTimer m_cultureTimer;
+
+  AbstractScene *m_bestScene;
+  float m_bestFitness;
+  float m_currentFitness;
+  QImage m_bestCandidate;
+  QImage m_currentCandidate;
+
+  QFile m_bestScenesFile;
+  QDataStream m_bestScenes;
+  QFile m_cultureLogFile;
+  QDataStream m_cultureLog;
+  QFile m_ageLogFile;
+  QDataStream m_ageLog;
+
+  SnapshotSlot m_snapshots;
+  QElapsedTimer m_publishTimer;
+  bool m_publishBestScene;
+  QByteArray m_bestSceneData;
+  MetricsServer *m_metrics;
+  QString m_metricsRun;
+};
+
+#endif // EVOLUTIONENGINE_H
@@ -0,0 +1,246 @@
+#include "evolutionparameters.h"
+
+#include <QSettings>
+#include <QFile>
+
+EvolutionParameters::EvolutionParameters()
+{
+  sceneType = "triangles";
+  fitnessType = "faceWeightedPixelSum";
+  triangleCount = 20;
+  populationSize = 10;
+  tournamentSize = 2;
+  selectionMethod = TopSelection;
+  mutationStrength = 0;
+  generationCount = 10000;
+  maxAge = 1;
+  cultureSchedule = FixedSchedule;
+  faceWeight = 10;
+  updatesPerSec = 25;
+  maxGenerations = 0;
+  maxSeconds = 0;
+  targetFitness = -1;
+  plateauWindow = 0;
+  plateauThreshold = 0.001f;
+  flameBackend = OpenCLBackend;
+  maxXforms = 5;
+  openclPlatform = 0;
+  openclDevice = 0;
+  screenDivisor = 4;
+  screenQuality = 10;
+  screenMargin = 0.25f;
+  screenAuditInterval = 20;
+  memoryBudgetMB = 0;
+  evaluationFormat = FullColourFormat;
+  fullColourAge = 0;
+  fitnessCacheSize = 65536;
+}
+
+bool EvolutionParameters::load( const QString &fn )
+{
+  // QSettings will happily read a file that isn't there, so check first
+  if ( ! QFile::exists( fn ) )
+    return false;
+
+  QSettings s( fn, QSettings::IniFormat );
+  if ( s.status() != QSettings::NoError )
+    return false;
+
+  QVariantMap values;
+  foreach( QString key, s.allKeys() )
+    values.insert( key, s.value( key ) );
+
+  return apply( values );
+}
+
+bool EvolutionParameters::save( const QString &fn ) const
+{
+  QSettings s( fn, QSettings::IniFormat );
+
+  QVariantMap values( toVariantMap() );
+  for( QVariantMap::const_iterator i = values.constBegin(); i != values.constEnd(); ++ i )
+    s.setValue( i.key(), i.value() );
+
+  s.sync();
+  return s.status() == QSettings::NoError;
+}
+
+bool EvolutionParameters::apply( const QVariantMap &v )
+{
+  // the names are checked against the plugin registry when the engine starts
+  sceneType = v.value( "sceneType", sceneType ).toString();
+  fitnessType = v.value( "fitnessType", fitnessType ).toString();
+  if ( sceneType.isEmpty() || fitnessType.isEmpty() )
+    return false;
+
+  triangleCount = v.value( "triangleCount", triangleCount ).toInt();
+  populationSize = v.value( "populationSize", populationSize ).toInt();
+  tournamentSize = v.value( "tournamentSize", tournamentSize ).toInt();
+  QString selection = v.value( "selection/method", selectionMethodName( selectionMethod ) ).toString();
+  if ( selection == "top" )
+    selectionMethod = TopSelection;
+  else if ( selection == "tournament" )
+    selectionMethod = TournamentSelection;
+  else if ( selection == "truncation" )
+    selectionMethod = TruncationSelection;
+  else if ( selection == "rank" )
+    selectionMethod = RankSelection;
+  else
+    return false;
+  mutationStrength = v.value( "mutationStrength", mutationStrength ).toInt();
+  generationCount = v.value( "generationCount", generationCount ).toInt();
+  maxAge = v.value( "maxAge", maxAge ).toInt();
+  QString schedule = v.value( "schedule/cultures", cultureScheduleName( cultureSchedule ) ).toString();
+  if ( schedule == "fixed" )
+    cultureSchedule = FixedSchedule;
+  else if ( schedule == "halving" )
+    cultureSchedule = HalvingSchedule;
+  else
+    return false;
+  faceWeight = v.value( "faceWeight", faceWeight ).toInt();
+  updatesPerSec = v.value( "updatesPerSec", updatesPerSec ).toInt();
+
+  maxGenerations = v.value( "budget/maxGenerations", maxGenerations ).toInt();
+  maxSeconds = v.value( "budget/maxSeconds", maxSeconds ).toInt();
+  targetFitness = v.value( "budget/targetFitness", targetFitness ).toFloat();
+  plateauWindow = v.value( "plateau/window", plateauWindow ).toInt();
+  plateauThreshold = v.value( "plateau/threshold", plateauThreshold ).toFloat();
+
+  palettesFile = v.value( "flames/palettesFile", palettesFile ).toString();
+  QString backend = v.value( "flames/backend", flameBackend == CpuBackend ? "cpu" : "opencl" ).toString();
+  if ( backend == "cpu" )
+    flameBackend = CpuBackend;
+  else if ( backend == "opencl" )
+    flameBackend = OpenCLBackend;
+  else
+    return false;
+  openclPlatform = v.value( "flames/openclPlatform", openclPlatform ).toInt();
+  openclDevice = v.value( "flames/openclDevice", openclDevice ).toInt();
+  maxXforms = v.value( "flames/maxXforms", maxXforms ).toInt();
+  screenDivisor = v.value( "flames/screenDivisor", screenDivisor ).toInt();
+  screenQuality = v.value( "flames/screenQuality", screenQuality ).toInt();
+  screenMargin = v.value( "flames/screenMargin", screenMargin ).toFloat();
+  screenAuditInterval = v.value( "flames/screenAuditInterval", screenAuditInterval ).toInt();
+
+  memoryBudgetMB = v.value( "memory/budgetMB", memoryBudgetMB ).toInt();
+
+  QString format = v.value( "evaluation/format", evaluationFormatName( evaluationFormat ) ).toString();
+  if ( format == "rgb32" )
+    evaluationFormat = FullColourFormat;
+  else if ( format == "luma8" )
+    evaluationFormat = LumaFormat;
+  else if ( format == "rgb565" )
+    evaluationFormat = Rgb565Format;
+  else
+    return false;
+  fullColourAge = v.value( "evaluation/fullColourAge", fullColourAge ).toInt();
+  fitnessCacheSize = v.value( "evaluation/cacheSize", fitnessCacheSize ).toInt();
+
+  // the pool is bred in pairs, and survivors are picked from the best tournamentSize of twice the pool
+  if ( populationSize < 2 || populationSize % 2 || tournamentSize < 1 || tournamentSize > populationSize + 1 )
+    return false;
+  if ( generationCount < 1 || maxAge < 1 || updatesPerSec < 1 )
+    return false;
+  if ( maxGenerations < 0 || maxSeconds < 0 || plateauWindow < 0 || plateauThreshold < 0 )
+    return false;
+  if ( maxXforms < 1 || screenDivisor < 1 || screenQuality < 1 || screenMargin < 0 || screenAuditInterval < 0 )
+    return false;
+  if ( memoryBudgetMB < 0 || fullColourAge < 0 || fitnessCacheSize < 0 )
+    return false;
+
+  return true;
+}
+
+QString EvolutionParameters::evaluationFormatName( EvaluationFormat format )
+{
+  switch( format )
+  {
+  case LumaFormat:
+    return "luma8";
+  case Rgb565Format:
+    return "rgb565";
+  default:
+    return "rgb32";
+  }
+}
+
+QString EvolutionParameters::selectionMethodName( SelectionMethod method )
+{
+  switch( method )
+  {
+  case TournamentSelection:
+    return "tournament";
+  case TruncationSelection:
+    return "truncation";
+  case RankSelection:
+    return "rank";
+  default:
+    return "top";
+  }
+}
+
+QString EvolutionParameters::cultureScheduleName( CultureSchedule schedule )
+{
+  switch( schedule )
+  {
+  case HalvingSchedule:
+    return "halving";
+  default:
+    return "fixed";
+  }
+}
+
+QImage::Format EvolutionParameters::imageFormat( EvaluationFormat format )
+{
+  switch( format )
+  {
+  case LumaFormat:
+    return QImage::Format_Grayscale8;
+  case Rgb565Format:
+    return QImage::Format_RGB16;
+  default:
+    return QImage::Format_RGB32;
+  }
+}
+
+QVariantMap EvolutionParameters::toVariantMap() const
+{
+  QVariantMap v;
+
+  v.insert( "sceneType", sceneType );
+  v.insert( "fitnessType", fitnessType );
+  v.insert( "triangleCount", triangleCount );
+  v.insert( "populationSize", populationSize );
+  v.insert( "tournamentSize", tournamentSize );
+  v.insert( "selection/method", selectionMethodName( selectionMethod ) );
+  v.insert( "mutationStrength", mutationStrength );
+  v.insert( "generationCount", generationCount );
+  v.insert( "maxAge", maxAge );
+  v.insert( "schedule/cultures", cultureScheduleName( cultureSchedule ) );
+  v.insert( "faceWeight", faceWeight );
+  v.insert( "updatesPerSec", updatesPerSec );
+
+  v.insert( "budget/maxGenerations", maxGenerations );
+  v.insert( "budget/maxSeconds", maxSeconds );
+  v.insert( "budget/targetFitness", targetFitness );
+  v.insert( "plateau/window", plateauWindow );
+  v.insert( "plateau/threshold", plateauThreshold );
+
+  v.insert( "flames/palettesFile", palettesFile );
+  v.insert( "flames/backend", flameBackend == CpuBackend ? "cpu" : "opencl" );
+  v.insert( "flames/openclPlatform", openclPlatform );
+  v.insert( "flames/openclDevice", openclDevice );
+  v.insert( "flames/maxXforms", maxXforms );
+  v.insert( "flames/screenDivisor", screenDivisor );
+  v.insert( "flames/screenQuality", screenQuality );
+  v.insert( "flames/screenMargin", screenMargin );
+  v.insert( "flames/screenAuditInterval", screenAuditInterval );
+
+  v.insert( "memory/budgetMB", memoryBudgetMB );
+
+  v.insert( "evaluation/format", evaluationFormatName( evaluationFormat ) );
+  v.insert( "evaluation/fullColourAge", fullColourAge );
+  v.insert( "evaluation/cacheSize", fitnessCacheSize );
+
+  return v;
+}
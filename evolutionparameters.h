@@ -0,0 +1,125 @@
+#ifndef EVOLUTIONPARAMETERS_H
+#define EVOLUTIONPARAMETERS_H
+
+#include <QString>
+#include <QVariantMap>
+#include <QImage>
+
+/** Everything that controls a single run of the optimiser, independent of how it's being driven (dialog, command line) */
+
+struct EvolutionParameters
+{
+  /// what renders flame scenes
+  enum FlameBackend { OpenCLBackend, CpuBackend };
+  /// the pixel format children are rendered and scored in
+  enum EvaluationFormat { FullColourFormat, LumaFormat, Rgb565Format };
+  /// how the survivors of each generation are picked. see Selection
+  enum SelectionMethod { TopSelection, TournamentSelection, TruncationSelection, RankSelection };
+  /// how generations are shared out between the cultures of an age
+  enum CultureSchedule { FixedSchedule, HalvingSchedule };
+
+  /// initialises everything to the same defaults the dialog starts with
+  EvolutionParameters();
+
+  /// reads parameters from an ini-style file. anything not in the file keeps its current value
+  bool load( const QString &fn );
+  /// writes the parameters to an ini-style file that load() can read back
+  bool save( const QString &fn ) const;
+
+  /// sets any parameters present in the map, keyed the same as the ini file ("group/name" for
+  /// anything in a group). returns false if the result isn't a usable set of parameters
+  bool apply( const QVariantMap &values );
+  /// all of the parameters, keyed the same as the ini file
+  QVariantMap toVariantMap() const;
+
+  /// the name an evaluation format has in the ini file
+  static QString evaluationFormatName( EvaluationFormat format );
+  /// the image format candidates are rendered into for an evaluation format
+  static QImage::Format imageFormat( EvaluationFormat format );
+  /// the name a selection method has in the ini file
+  static QString selectionMethodName( SelectionMethod method );
+  /// the name a culture schedule has in the ini file
+  static QString cultureScheduleName( CultureSchedule schedule );
+
+  /// the kind of scene being evolved, by name ("triangles", or "flames" if the flame plugin is installed)
+  QString sceneType;
+  /// the fitness function, by name
+  QString fitnessType;
+
+  /// number of triangles per scene (triangle scenes only)
+  int triangleCount;
+  /// number of scenes per culture
+  int populationSize;
+  /// number of best candidates that the survivors are picked from each generation, or with tournament
+  /// selection, the number of candidates in each tournament
+  int tournamentSize;
+  /// how the survivors are picked from the parents and children. top, the original method, takes the
+  /// best and then picks at random from the best tournamentSize left
+  SelectionMethod selectionMethod;
+  /// % probability of another mutation being applied to a child
+  int mutationStrength;
+  /// number of generations per culture in the first age
+  int generationCount;
+  /// number of ages. the last age runs until stopped
+  int maxAge;
+  /// fixed gives every culture of an age the same generationCount * 2^age generations. halving races
+  /// them for the same total: every culture runs a short rung, the better half go on to a longer
+  /// one, and so on until one is left, so hopeless cultures stop early and the leaders get their budget
+  CultureSchedule cultureSchedule;
+  /// extra weighting given to pixels that are part of a detected face
+  int faceWeight;
+  /// how often progress snapshots are published, per second
+  int updatesPerSec;
+
+  // budget for the whole run. the run stops when any of these is reached
+  /// total generations across all cultures and ages, or 0 for no limit
+  int maxGenerations;
+  /// seconds spent evolving (not counting time spent queued behind other jobs), or 0 for no limit
+  int maxSeconds;
+  /// stop once the best fitness is at least this good, or negative for no target
+  float targetFitness;
+
+  // plateau detection. a culture has plateaued once its fitness has improved by no more than
+  // plateauThreshold (as a fraction of what it was) over the last plateauWindow generations
+  /// generations to measure the improvement over, or 0 to never stop for a plateau
+  int plateauWindow;
+  /// the smallest relative improvement over the window that doesn't count as a plateau
+  float plateauThreshold;
+
+  // flame scenes only
+  QString palettesFile;
+  FlameBackend flameBackend;
+  /// most xforms a flame can have
+  int maxXforms;
+  int openclPlatform;
+  int openclDevice;
+
+  // screening: children are first rendered small and rough, and only those that might make the cut
+  // get a full render. only scenes with a cheap preview render (flames) are screened
+  /// preview size as a fraction of the target (4 = a quarter of the width and height), or 1 to turn screening off
+  int screenDivisor;
+  /// render quality of the previews
+  int screenQuality;
+  /// how far a preview's estimated fitness can be from the selection cutoff and still get a full render,
+  /// as a fraction of the cutoff. larger rejects less, and wrongly rejects less
+  float screenMargin;
+  /// one in this many rejected children gets a full render anyway, to measure how often screening
+  /// gets it wrong. 0 for never
+  int screenAuditInterval;
+
+  /// most memory, in MB, for the images the engine works with. a target too big to load and render
+  /// whole within it is mapped from disk, and children are rendered and scored a strip at a time.
+  /// 0 for no limit
+  int memoryBudgetMB;
+
+  /// the format children are rendered and scored in. the reduced formats move less memory per
+  /// evaluation, but their fitness isn't comparable with full colour fitness
+  EvaluationFormat evaluationFormat;
+  /// switches to full colour at the start of this age, or 0 to stay in evaluationFormat
+  int fullColourAge;
+  /// how many scene fitnesses are remembered, so children identical to a scene already scored aren't
+  /// evaluated again. 0 turns the cache off
+  int fitnessCacheSize;
+};
+
+#endif // EVOLUTIONPARAMETERS_H
@@ -0,0 +1,141 @@
+#ifndef EVOLUTIONSNAPSHOT_H
+#define EVOLUTIONSNAPSHOT_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QAtomicPointer>
+#include <QStringList>
+
+/** How well screening children with cheap preview renders is working. A screening decision is only
+    checked when a full render follows it: every child that passes, and a sample of those rejected */
+
+struct ScreeningStats
+{
+  ScreeningStats() : screened( 0 ), rejected( 0 ), audited( 0 ), falseRejects( 0 ), confirmed( 0 ), falsePasses( 0 ) {}
+
+  /// children given a preview render
+  quint64 screened;
+  /// children that the preview ruled out
+  quint64 rejected;
+  /// rejected children given a full render anyway
+  quint64 audited;
+  /// audited children that would have made the cut after all
+  quint64 falseRejects;
+  /// children that passed the preview and got a full render
+  quint64 confirmed;
+  /// passed children that didn't make the cut once fully rendered
+  quint64 falsePasses;
+
+  /// fraction of the checked decisions that the full render disagreed with
+  double disagreementRate() const
+  {
+    quint64 checked = audited + confirmed;
+    return checked ? static_cast< double > ( falseRejects + falsePasses ) / static_cast< double > ( checked ) : 0;
+  }
+};
+
+/** Where the hot loop spends its time. Every moment inside a step is charged to exactly one phase, so
+    the phases add up to the engine's active time */
+
+struct PhaseStats
+{
+  enum Phase { Breeding, Screening, Rendering, Fitness, Sorting, Logging, Publishing, PhaseCount };
+
+  PhaseStats() : evaluations( 0 ), allocations( 0 ), cacheLookups( 0 ), cacheHits( 0 )
+  {
+    for( int i = 0; i < PhaseCount; ++ i )
+      nsecs[i] = 0;
+  }
+
+  /// nanoseconds spent in each phase
+  qint64 nsecs[PhaseCount];
+  /// scenes given a full render and score (screening previews aren't counted)
+  quint64 evaluations;
+  /// scenes and render buffers created
+  quint64 allocations;
+  /// children looked up in the fitness cache, and those that took a known fitness rather than being evaluated
+  quint64 cacheLookups;
+  quint64 cacheHits;
+
+  /// the fraction of lookups that found a fitness
+  double cacheHitRate() const { return cacheLookups ? static_cast< double > ( cacheHits ) / cacheLookups : 0; }
+
+  qint64 totalNsecs() const
+  {
+    qint64 total = 0;
+    for( int i = 0; i < PhaseCount; ++ i )
+      total += nsecs[i];
+    return total;
+  }
+
+  static const char *phaseName( int phase )
+  {
+    static const char *names[PhaseCount] = { "breeding", "screening", "rendering", "fitness", "sorting", "logging", "publishing" };
+    return phase >= 0 && phase < PhaseCount ? names[phase] : "";
+  }
+
+  /// each phase's share of the time, such as "rendering 61%, fitness 30%". phases that took no time are left out
+  QString summary() const
+  {
+    qint64 total = totalNsecs();
+    QStringList parts;
+    for( int i = 0; total > 0 && i < PhaseCount; ++ i )
+    {
+      if ( nsecs[i] > 0 )
+        parts << QString( "%1 %2%" ).arg( phaseName( i ) ).arg( 100.0 * nsecs[i] / total, 0, 'f', 0 );
+    }
+    return parts.join( ", " );
+  }
+};
+
+/** A copy of the optimiser's progress, handed from the evolution thread to whoever is displaying it */
+
+struct EvolutionSnapshot
+{
+  int iterations;
+  quint64 acceptCount;
+  int improvements;
+  int age;
+  int culture;
+  int maxCultures;
+  int maxIterations;
+  float iterationsPerSec;
+  quint64 totalGenerations;
+  /// full evaluations per second of active time, over the whole run
+  float evaluationsPerSec;
+
+  float bestFitness;
+  float currentFitness;
+
+  ScreeningStats screening;
+  PhaseStats phases;
+
+  QImage bestCandidate;
+  QImage currentCandidate;
+
+  /// the best scene so far, as written by saveToStream. only filled in if the engine was asked to
+  QByteArray bestScene;
+};
+
+/** A single-entry, lock-free mailbox for snapshots. The producer replaces whatever is in
+    the slot, the consumer takes whatever is there, so neither side ever waits on the other */
+
+class SnapshotSlot
+{
+public:
+  SnapshotSlot() : m_snapshot( 0 ) {}
+  ~SnapshotSlot() { delete m_snapshot.fetchAndStoreOrdered( 0 ); }
+
+  /// publishes a new snapshot, taking ownership of it. any snapshot that hasn't been taken yet is discarded
+  void publish( EvolutionSnapshot *snapshot ) { delete m_snapshot.fetchAndStoreOrdered( snapshot ); }
+
+  /// takes ownership of the most recent snapshot, or returns 0 if nothing new has been published
+  EvolutionSnapshot *take() { return m_snapshot.fetchAndStoreOrdered( 0 ); }
+
+private:
+  Q_DISABLE_COPY( SnapshotSlot )
+
+  QAtomicPointer< EvolutionSnapshot > m_snapshot;
+};
+
+#endif // EVOLUTIONSNAPSHOT_H
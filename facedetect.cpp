@@ -51,7 +51,8 @@ CvRect detect_and_draw( IplImage* img, CvMemStorage* storage, CvHaarClassifierCa
 QList< QRect > detectFaces( const QImage &_image )
 {
   QList< QRect > faces;
-  QImage image( _image );
+  // the detector reads four bytes a pixel, whatever format the image was evaluated in
+  QImage image( _image.convertToFormat( QImage::Format_RGB32 ) );
 
   const char *CASCADE_NAME = "haarcascade_frontalface_alt.xml";
 
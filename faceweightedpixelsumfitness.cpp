@@ -1,65 +1,199 @@
 #include "faceweightedpixelsumfitness.h"
 #include "facedetect.h"
+#include "fitnesskernels.h"
 
 #include <QPainter>
 
-FaceWeightedPixelSumFitness::FaceWeightedPixelSumFitness(const QImage &image, int faceWeight)
+#include <string.h>
+
+FaceWeightedPixelSumFitness::FaceWeightedPixelSumFitness(const TargetImage &image, int faceWeight)
   : AbstractFitness( image )
   , m_faceWeight( faceWeight )
 {
   doFaceDetection();
+  weightFaces();
+}
+
+FaceWeightedPixelSumFitness::FaceWeightedPixelSumFitness( const TargetImage &image, int faceWeight, const QList< QRect > &faces )
+  : AbstractFitness( image )
+  , m_faceWeight( faceWeight )
+  , m_faces( faces )
+{
+  weightFaces();
+}
+
+FaceWeightedPixelSumFitness::~FaceWeightedPixelSumFitness()
+{
+  for( int y = 0; y < m_pixelWeights.size(); ++ y )
+  {
+    if ( m_pixelWeights[y] != m_noWeights.constData() )
+      delete[] m_pixelWeights[y];
+  }
 }
 
 void FaceWeightedPixelSumFitness::doFaceDetection()
 {
-  m_faces = detectFaces( target() );
-
-  m_faceMask = QImage( target().size(), QImage::Format_RGB32 );
-  m_faceMask.fill( 0 );
-  QPainter pm( &m_faceMask );
-  pm.setPen( Qt::NoPen );
-  pm.setBrush( QColor( 255, 255, 255 ) );
-  for( int i = 0; i < m_faces.count(); ++ i )
-    pm.drawEllipse( m_faces.at( i ) );
-
-  m_pixelWeights.resize( m_faceMask.height() );
-  for( int y = 0; y < m_faceMask.height(); ++ y )
+  // the detector gets a copy no bigger than it needs, and the faces it finds are scaled back up
+  QSize detectSize( target().size() );
+  if ( detectSize.width() > FACE_DETECT_SIZE || detectSize.height() > FACE_DETECT_SIZE )
+    detectSize.scale( FACE_DETECT_SIZE, FACE_DETECT_SIZE, Qt::KeepAspectRatio );
+  qreal scaleX = qreal( target().width() ) / detectSize.width();
+  qreal scaleY = qreal( target().height() ) / detectSize.height();
+  foreach( QRect face, detectFaces( target().scaled( detectSize ) ) )
+    m_faces << QRect( qRound( face.x() * scaleX ), qRound( face.y() * scaleY ), qRound( face.width() * scaleX ), qRound( face.height() * scaleY ) );
+}
+
+void FaceWeightedPixelSumFitness::weightFaces()
+{
+  // rows without a face share one row of zeroes, so a huge target with a small face doesn't need a
+  // weight for every pixel
+  int w = target().width();
+  m_noWeights.fill( 0, w );
+  m_pixelWeights.fill( m_noWeights.constData(), target().height() );
+
+  QRect faceRows;
+  foreach( QRect face, m_faces )
+    faceRows |= face;
+  faceRows = QRect( 0, faceRows.top() - 1, w, faceRows.height() + 2 ).intersected( QRect( QPoint( 0, 0 ), target().size() ) );
+
+  // the mask is drawn a strip at a time, shifted up by whole rows so it comes out the same as drawing it all at once
+  int stripRows = qMax( 1, MASK_STRIP_BYTES / ( w * 4 ) );
+  for( int top = faceRows.top(); top <= faceRows.bottom(); top += stripRows )
   {
-    m_pixelWeights[y] = new unsigned char[m_faceMask.width()];
-    for( int x = 0; x < m_faceMask.width(); ++ x )
+    int rows = qMin( stripRows, faceRows.bottom() + 1 - top );
+
+    QImage mask( w, rows, QImage::Format_RGB32 );
+    mask.fill( 0 );
+    QPainter pm( &mask );
+    pm.translate( 0, -top );
+    pm.setPen( Qt::NoPen );
+    pm.setBrush( QColor( 255, 255, 255 ) );
+    for( int i = 0; i < m_faces.count(); ++ i )
+      pm.drawEllipse( m_faces.at( i ) );
+    pm.end();
+
+    for( int y = 0; y < rows; ++ y )
     {
-      m_pixelWeights[y][x] = qRed(m_faceMask.pixel(x, y)) > 0 ? 1 : 0;
+      const QRgb *line = reinterpret_cast< const QRgb* > ( mask.constScanLine( y ) );
+      unsigned char *weights = 0;
+      for( int x = 0; x < w; ++ x )
+      {
+        if ( qRed( line[x] ) > 0 )
+        {
+          if ( ! weights )
+            weights = new unsigned char[w]();
+          weights[x] = 1;
+        }
+      }
+
+      if ( weights )
+        m_pixelWeights[top + y] = weights;
     }
   }
 }
 
+void FaceWeightedPixelSumFitness::replicateTo( int node )
+{
+  int w = target().width();
+  int faceRows = 0;
+  for( int y = 0; y < m_pixelWeights.size(); ++ y )
+  {
+    if ( m_pixelWeights[y] != m_noWeights.constData() )
+      ++ faceRows;
+  }
+
+  // the block is zeroed as it's allocated, which leaves the row without a face already filled in
+  m_nodeWeights.resize( node + 1 );
+  m_nodeWeightData.resize( node + 1 );
+  QVector< unsigned char > &data = m_nodeWeightData[node];
+  data.fill( 0, ( faceRows + 1 ) * w );
+
+  QVector< const unsigned char * > &rows = m_nodeWeights[node];
+  rows.fill( data.constData(), m_pixelWeights.size() );
+  unsigned char *next = data.data() + w;
+  for( int y = 0; y < m_pixelWeights.size(); ++ y )
+  {
+    if ( m_pixelWeights[y] == m_noWeights.constData() )
+      continue;
+    memcpy( next, m_pixelWeights[y], w );
+    rows[y] = next;
+    next += w;
+  }
+}
+
+const QVector< const unsigned char * > &FaceWeightedPixelSumFitness::pixelWeights() const
+{
+  int node = NumaTopology::threadNode();
+  return node < 0 || node >= m_nodeWeights.size() ? m_pixelWeights : m_nodeWeights[node];
+}
+
 float FaceWeightedPixelSumFitness::getFitness( const QImage &candidate ) const
 {
   float f = 0;
-  int w = target().width();
   int h = target().height();
-  for( int y = 0; y < h; ++ y )
+  int rows = bandRows();
+  for( int top = 0; top < h; top += rows )
+    f += sumRows( candidate, 0, top, qMin( h, top + rows ) );
+
+  return f;
+}
+
+void FaceWeightedPixelSumFitness::getFitnesses( const QVector< const QImage* > &candidates, QVector< float > &results ) const
+{
+  int h = target().height();
+  int rows = bandRows();
+  int count = candidates.size();
+
+  results.fill( 0, count );
+
+  for( int top = 0; top < h; top += rows )
   {
-    const uchar *targetLine = target().scanLine( y );
-    const uchar *candidateLine = candidate.scanLine( y );
-    const uchar *weights = m_pixelWeights[y];
+    int end = qMin( h, top + rows );
+    for( int c = 0; c < count; ++ c )
+      results[c] += sumRows( *candidates[c], 0, top, end );
+  }
+}
 
-    // calculates the difference between pixels on the two images
-    for( int x = 0; x < w; ++ x )
-    {
-      float dB = (float)(*(targetLine++) - *(candidateLine++));
-      float dG = (float)(*(targetLine++) - *(candidateLine++));
-      float dR = (float)(*(targetLine++) - *(candidateLine++));
-      ++targetLine; ++candidateLine;
+int FaceWeightedPixelSumFitness::bandRows() const
+{
+  // the target's pixels, plus a byte of weight each
+  int bytesPerPixel = target().bytesPerLine() / qMax( 1, target().width() ) + 1;
+  return qMax( 1, BAND_BYTES / qMax( 1, target().width() * bytesPerPixel ) );
+}
 
-      // larger number is better. multiplies pixels detected as part of a face by faceWeight
-      // this gives a better weighting to face pixels and will accept candidates that have a better
-      // match for those areas
-      float pixelFitness = (dR * dR + dG * dG + dB * dB) * (float)(m_faceWeight * weights[x] + 1 );
+void FaceWeightedPixelSumFitness::getBandFitnesses( const QImage &rows, int top, float *partials ) const
+{
+  int end = top + rows.height();
+  int band = bandRows();
+  for( int bandTop = top; bandTop < end; bandTop += band )
+    *(partials++) = sumRows( rows, top, bandTop, qMin( end, bandTop + band ) );
+}
 
-      f += pixelFitness;
-    }
+float FaceWeightedPixelSumFitness::sumRows( const QImage &candidate, int candidateTop, int top, int end ) const
+{
+  const FitnessKernels::Kernels &kernels = FitnessKernels::current();
+  FitnessKernels::RowKernel kernel;
+  switch( target().format() )
+  {
+  case QImage::Format_Grayscale8:
+    kernel = kernels.luma8;
+    break;
+  case QImage::Format_RGB16:
+    kernel = kernels.rgb565;
+    break;
+  default:
+    kernel = kernels.rgb32;
   }
 
-  return f;
+  // larger number is better. pixels detected as part of a face count faceWeight more times over, which
+  // gives a better weighting to face pixels and will accept candidates that have a better match for those areas
+  quint64 all = 0;
+  quint64 face = 0;
+  const TargetImage &t = target();
+  const QVector< const unsigned char * > &weights = pixelWeights();
+  int w = t.width();
+  for( int y = top; y < end; ++ y )
+    kernel( t.scanLine( y ), candidate.scanLine( y - candidateTop ), weights[y], w, &all, &face );
+
+  return float( double( all ) + double( face ) * m_faceWeight );
 }
@@ -6,21 +6,55 @@
 
 class FaceWeightedPixelSumFitness : public AbstractFitness {
 public:
-  FaceWeightedPixelSumFitness( const QImage &image, int faceWeight );
-  virtual ~FaceWeightedPixelSumFitness() {}
+  FaceWeightedPixelSumFitness( const TargetImage &image, int faceWeight );
+  /// weights the faces given, rather than looking for them. for targets whose faces are already known,
+  /// and for benchmarking without a face in the picture
+  FaceWeightedPixelSumFitness( const TargetImage &image, int faceWeight, const QList< QRect > &faces );
+  virtual ~FaceWeightedPixelSumFitness();
 
   /// renders a scene and calcuates the similarity to the target image
   float getFitness( const QImage &image ) const;
+  /// scores the candidates a band of rows at a time, so each band of the target and weights is
+  /// read from memory once for all of them rather than once per candidate
+  virtual void getFitnesses( const QVector< const QImage* > &candidates, QVector< float > &results ) const;
+
+  virtual int bandRows() const;
+  virtual void getBandFitnesses( const QImage &rows, int top, float *partials ) const;
 
   virtual SceneComparisonFunction sceneHasBetterFitnessMethod() const { return AbstractFitness::sceneHasBetterFitness; }
 
+protected:
+  virtual void replicateTo( int node );
+
 private:
   void doFaceDetection();
-
-  QVector< unsigned char * > m_pixelWeights;
+  /// fills in m_pixelWeights from m_faces
+  void weightFaces();
+  /// the weights, or the replica on the calling worker's node if there is one
+  const QVector< const unsigned char * > &pixelWeights() const;
+
+  /// sums the differences over the target rows from top to end, reading the candidate from the row
+  /// candidateTop down. every score is built from these band sums, added in order, so the batch,
+  /// banded and single scores come out identical. the rows themselves are summed by FitnessKernels,
+  /// in integers, so they also come out identical whichever instruction set is in use
+  float sumRows( const QImage &candidate, int candidateTop, int top, int end ) const;
+
+  /// roughly how much target and weight data a band of rows covers, so a band stays in L2 while every candidate is compared
+  static const int BAND_BYTES = 128 * 1024;
+
+  /// faces are detected on a copy of the target scaled down to fit this size
+  static const int FACE_DETECT_SIZE = 2048;
+  /// how much of the face mask is drawn at once
+  static const int MASK_STRIP_BYTES = 16 * 1024 * 1024;
+
+  /// one row of weights per row of the target. rows without a face all point at m_noWeights
+  QVector< const unsigned char * > m_pixelWeights;
+  QVector< unsigned char > m_noWeights;
+  /// per node copies of the weights. each node's rows point into one block, the row of zeroes first
+  QVector< QVector< const unsigned char * > > m_nodeWeights;
+  QVector< QVector< unsigned char > > m_nodeWeightData;
   int m_faceWeight;
 
-  QImage m_faceMask;
   QList< QRect > m_faces;
 };
 
@@ -0,0 +1,57 @@
+#include "fitnesscache.h"
+
+FitnessCache::FitnessCache( int capacity )
+  : m_shardCapacity( capacity > 0 ? qMax( 1, capacity / SHARD_COUNT ) : 0 )
+{
+}
+
+bool FitnessCache::find( quint64 hash, float *fitness ) const
+{
+  if ( ! isEnabled() )
+    return false;
+
+  Shard &s = shard( hash );
+  QMutexLocker locker( &s.mutex );
+  QHash< quint64, float >::const_iterator i = s.entries.constFind( hash );
+  if ( i == s.entries.constEnd() )
+    return false;
+
+  *fitness = i.value();
+  return true;
+}
+
+void FitnessCache::insert( quint64 hash, float fitness )
+{
+  if ( ! isEnabled() )
+    return;
+
+  Shard &s = shard( hash );
+  QMutexLocker locker( &s.mutex );
+  QHash< quint64, float >::iterator i = s.entries.find( hash );
+  if ( i != s.entries.end() )
+  {
+    i.value() = fitness;
+    return;
+  }
+
+  if ( s.order.size() < m_shardCapacity )
+  {
+    s.order << hash;
+  } else {
+    s.entries.remove( s.order[s.next] );
+    s.order[s.next] = hash;
+    s.next = ( s.next + 1 ) % m_shardCapacity;
+  }
+  s.entries.insert( hash, fitness );
+}
+
+void FitnessCache::clear()
+{
+  for( int i = 0; i < SHARD_COUNT; ++ i )
+  {
+    QMutexLocker locker( &m_shards[i].mutex );
+    m_shards[i].entries.clear();
+    m_shards[i].order.clear();
+    m_shards[i].next = 0;
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef FITNESSCACHE_H
+#define FITNESSCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+/** Remembers the fitness of scenes by their AbstractScene::hash(), so a child that's identical to a
+    scene already scored takes its fitness instead of being rendered again. It holds a fixed number
+    of entries, split across shards with a lock each so any thread can use it, and a full shard
+    forgets its oldest entry to make room.
+
+    Fitness only means something against one target in one format, so the cache has to be cleared
+    whenever either changes */
+
+class FitnessCache
+{
+public:
+  /// a cache holding up to capacity entries. 0 turns it off
+  explicit FitnessCache( int capacity );
+
+  bool isEnabled() const { return m_shardCapacity > 0; }
+
+  /// looks a scene's hash up, setting fitness and returning true if it's there
+  bool find( quint64 hash, float *fitness ) const;
+  /// remembers the fitness for a hash, replacing the oldest entry in its shard if it's full
+  void insert( quint64 hash, float fitness );
+  /// forgets everything
+  void clear();
+
+private:
+  struct Shard
+  {
+    Shard() : next( 0 ) {}
+
+    mutable QMutex mutex;
+    QHash< quint64, float > entries;
+    /// the hashes in the order they were added, as a ring. next is the oldest, once it's full
+    QVector< quint64 > order;
+    int next;
+  };
+
+  /// the shard a hash lives in. it's picked from the top bits, as QHash uses the bottom ones
+  Shard &shard( quint64 hash ) const { return m_shards[hash >> ( 64 - SHARD_BITS )]; }
+
+  static const int SHARD_BITS = 4;
+  static const int SHARD_COUNT = 1 << SHARD_BITS;
+
+  mutable Shard m_shards[SHARD_COUNT];
+  int m_shardCapacity;
+};
+
+#endif // FITNESSCACHE_H
@@ -0,0 +1,265 @@
+#include "fitnesskernels.h"
+
+#include <QVector>
+
+#include "randomiser.h"
+
+// gcc only vectorises at -O3, or from version 12 at -O2, and these loops are the point of the file
+#if defined( __GNUC__ ) && ! defined( __clang__ )
+#pragma GCC optimize ( "tree-vectorize" )
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define FITNESS_KERNELS_X86
+#endif
+
+// the kernel bodies are written once, and inlined into a function per instruction set. the compiler
+// vectorises each copy for the instructions its function is allowed to use
+#if defined( __GNUC__ )
+#define KERNEL_INLINE inline __attribute__(( always_inline ))
+#define KERNEL_TARGET( isa ) __attribute__(( target( isa ) ))
+#else
+#define KERNEL_INLINE inline
+#define KERNEL_TARGET( isa )
+#endif
+
+namespace
+{
+
+KERNEL_INLINE void rgb32Row( const uchar *target, const uchar *candidate, const uchar *weights, int width, quint64 *all, quint64 *face )
+{
+  quint64 a = 0;
+  quint64 f = 0;
+  for( int x = 0; x < width; ++ x )
+  {
+    int dB = target[4 * x] - candidate[4 * x];
+    int dG = target[4 * x + 1] - candidate[4 * x + 1];
+    int dR = target[4 * x + 2] - candidate[4 * x + 2];
+    quint32 d = quint32( dR * dR + dG * dG + dB * dB );
+    a += d;
+    f += d * weights[x];
+  }
+  *all += a;
+  *face += f;
+}
+
+KERNEL_INLINE void luma8Row( const uchar *target, const uchar *candidate, const uchar *weights, int width, quint64 *all, quint64 *face )
+{
+  quint64 a = 0;
+  quint64 f = 0;
+  for( int x = 0; x < width; ++ x )
+  {
+    int d = target[x] - candidate[x];
+    quint32 d2 = quint32( 3 * d * d );
+    a += d2;
+    f += d2 * weights[x];
+  }
+  *all += a;
+  *face += f;
+}
+
+KERNEL_INLINE void rgb565Row( const uchar *target, const uchar *candidate, const uchar *weights, int width, quint64 *all, quint64 *face )
+{
+  const quint16 *t = reinterpret_cast< const quint16* > ( target );
+  const quint16 *c = reinterpret_cast< const quint16* > ( candidate );
+  quint64 a = 0;
+  quint64 f = 0;
+  for( int x = 0; x < width; ++ x )
+  {
+    int dR = ( ( t[x] >> 11 ) & 0x1f ) - ( ( c[x] >> 11 ) & 0x1f );
+    int dG = ( ( t[x] >> 5 ) & 0x3f ) - ( ( c[x] >> 5 ) & 0x3f );
+    int dB = ( t[x] & 0x1f ) - ( c[x] & 0x1f );
+    // shifted back up to 8 bits: red and blue by 3, green by 2
+    quint32 d = quint32( 64 * dR * dR + 16 * dG * dG + 64 * dB * dB );
+    a += d;
+    f += d * weights[x];
+  }
+  *all += a;
+  *face += f;
+}
+
+/// defines the three kernels for one instruction set, and a table of them
+#define DEFINE_KERNELS( suffix, attributes ) \
+  attributes void rgb32Row##suffix( const uchar *t, const uchar *c, const uchar *w, int width, quint64 *all, quint64 *face ) { rgb32Row( t, c, w, width, all, face ); } \
+  attributes void luma8Row##suffix( const uchar *t, const uchar *c, const uchar *w, int width, quint64 *all, quint64 *face ) { luma8Row( t, c, w, width, all, face ); } \
+  attributes void rgb565Row##suffix( const uchar *t, const uchar *c, const uchar *w, int width, quint64 *all, quint64 *face ) { rgb565Row( t, c, w, width, all, face ); } \
+  const FitnessKernels::Kernels s_kernels##suffix = { rgb32Row##suffix, luma8Row##suffix, rgb565Row##suffix };
+
+DEFINE_KERNELS( Baseline, )
+#ifdef FITNESS_KERNELS_X86
+DEFINE_KERNELS( Sse41, KERNEL_TARGET( "sse4.1" ) )
+DEFINE_KERNELS( Avx2, KERNEL_TARGET( "avx2" ) )
+DEFINE_KERNELS( Avx512, KERNEL_TARGET( "avx512f,avx512bw" ) )
+#endif
+
+#undef DEFINE_KERNELS
+
+}
+
+QAtomicPointer< const FitnessKernels::Kernels > FitnessKernels::s_current;
+
+bool FitnessKernels::isSupported( Variant variant )
+{
+  switch( variant )
+  {
+  case Baseline:
+    return true;
+#ifdef FITNESS_KERNELS_X86
+  case Sse41:
+    return __builtin_cpu_supports( "sse4.1" );
+  case Avx2:
+    return __builtin_cpu_supports( "avx2" );
+  case Avx512:
+    return __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" );
+#endif
+  default:
+    break;
+  }
+  return false;
+}
+
+const FitnessKernels::Kernels *FitnessKernels::kernels( Variant variant )
+{
+  if ( ! isSupported( variant ) )
+    return 0;
+
+  switch( variant )
+  {
+  case Baseline:
+    return &s_kernelsBaseline;
+#ifdef FITNESS_KERNELS_X86
+  case Sse41:
+    return &s_kernelsSse41;
+  case Avx2:
+    return &s_kernelsAvx2;
+  case Avx512:
+    return &s_kernelsAvx512;
+#endif
+  default:
+    break;
+  }
+  return 0;
+}
+
+FitnessKernels::Variant FitnessKernels::currentVariant()
+{
+  const Kernels *inUse = &current();
+  for( int v = 0; v < VariantCount; ++ v )
+  {
+    if ( kernels( Variant( v ) ) == inUse )
+      return Variant( v );
+  }
+  return Baseline;
+}
+
+bool FitnessKernels::setVariant( Variant variant )
+{
+  const Kernels *chosen = kernels( variant );
+  if ( ! chosen )
+    return false;
+
+  s_current.storeRelease( chosen );
+  return true;
+}
+
+QString FitnessKernels::variantName( Variant variant )
+{
+  switch( variant )
+  {
+  case Baseline:
+    return "baseline";
+  case Sse41:
+    return "sse4.1";
+  case Avx2:
+    return "avx2";
+  case Avx512:
+    return "avx512";
+  default:
+    break;
+  }
+  return QString();
+}
+
+FitnessKernels::Variant FitnessKernels::variantFromName( const QString &name )
+{
+  for( int v = 0; v < VariantCount; ++ v )
+  {
+    if ( variantName( Variant( v ) ) == name )
+      return Variant( v );
+  }
+  return VariantCount;
+}
+
+const FitnessKernels::Kernels &FitnessKernels::select()
+{
+  // an override that can't be honoured falls back to the best there is, rather than failing the run
+  QString forced( qgetenv( "TRIANGLES_ISA" ) );
+  if ( ! forced.isEmpty() )
+  {
+    if ( setVariant( variantFromName( forced ) ) )
+      return *s_current.loadAcquire();
+    qWarning( "TRIANGLES_ISA=%s isn't supported here, so picking from cpuid", qPrintable( forced ) );
+  }
+
+  for( int v = VariantCount - 1; v >= 0; -- v )
+  {
+    if ( setVariant( Variant( v ) ) )
+      break;
+  }
+  return *s_current.loadAcquire();
+}
+
+bool FitnessKernels::selfCheck( QString *failure )
+{
+  // widths either side of every vector length, so the remainder loops are covered as well as the main ones
+  QList< int > widths;
+  widths << 1 << 3 << 7 << 15 << 16 << 17 << 31 << 33 << 63 << 64 << 65 << 127 << 257 << 1023;
+
+  for( int i = 0; i < widths.count(); ++ i )
+  {
+    int width = widths[i];
+    QVector< uchar > target( width * 4 );
+    QVector< uchar > candidate( width * 4 );
+    QVector< uchar > weights( width );
+    for( int x = 0; x < width * 4; ++ x )
+    {
+      // plenty of extremes, as that's where an overflowing lane would show
+      target[x] = uchar( Randomiser::randomInt( 4 ) == 0 ? 255 : Randomiser::randomInt( 256 ) );
+      candidate[x] = uchar( Randomiser::randomInt( 4 ) == 0 ? 0 : Randomiser::randomInt( 256 ) );
+    }
+    for( int x = 0; x < width; ++ x )
+      weights[x] = uchar( Randomiser::randomInt( 2 ) );
+
+    for( int format = 0; format < 3; ++ format )
+    {
+      quint64 expectedAll = 0;
+      quint64 expectedFace = 0;
+      RowKernel baseline = format == 0 ? s_kernelsBaseline.rgb32 : format == 1 ? s_kernelsBaseline.luma8 : s_kernelsBaseline.rgb565;
+      baseline( target.constData(), candidate.constData(), weights.constData(), width, &expectedAll, &expectedFace );
+
+      for( int v = Baseline + 1; v < VariantCount; ++ v )
+      {
+        const Kernels *variant = kernels( Variant( v ) );
+        if ( ! variant )
+          continue;
+
+        quint64 all = 0;
+        quint64 face = 0;
+        RowKernel kernel = format == 0 ? variant->rgb32 : format == 1 ? variant->luma8 : variant->rgb565;
+        kernel( target.constData(), candidate.constData(), weights.constData(), width, &all, &face );
+
+        if ( all != expectedAll || face != expectedFace )
+        {
+          if ( failure )
+          {
+            static const char *formats[] = { "rgb32", "luma8", "rgb565" };
+            *failure = QString( "%1 %2 kernel disagrees with the baseline on a row of %3 pixels" ).arg( variantName( Variant( v ) ) ).arg( formats[format] ).arg( width );
+          }
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
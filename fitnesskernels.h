@@ -0,0 +1,62 @@
+#ifndef FITNESSKERNELS_H
+#define FITNESSKERNELS_H
+
+#include <QtGlobal>
+#include <QString>
+
+/** The inner loops of the pixel-difference fitness, compiled several times over for different
+    instruction sets, with the best one the cpu supports picked the first time they're used. The
+    build's own -march only sets the baseline, so one binary runs everywhere and still gets wide
+    vectors where they're available.
+
+    The kernels only do integer arithmetic, which comes out the same however it's split into vector
+    lanes, so every variant gives bit-identical fitness. selfCheck() makes sure of it */
+
+class FitnessKernels
+{
+public:
+  enum Variant { Baseline, Sse41, Avx2, Avx512, VariantCount };
+
+  /// adds the squared channel differences along a row of width pixels to all, and the same for just the
+  /// pixels with a face weight to face
+  typedef void (*RowKernel)( const uchar *target, const uchar *candidate, const uchar *weights, int width, quint64 *all, quint64 *face );
+
+  /// one kernel per evaluation format
+  struct Kernels
+  {
+    /// RGB32. the padding byte is ignored
+    RowKernel rgb32;
+    /// Grayscale8. each difference counts three times, as if the grey were in all three channels
+    RowKernel luma8;
+    /// RGB16 (565). channels are scaled back up to 8 bits before they're compared
+    RowKernel rgb565;
+  };
+
+  /// the kernels in use. picked from cpuid the first time, unless TRIANGLES_ISA names a variant to use instead
+  static const Kernels &current() { const Kernels *kernels = s_current.loadAcquire(); return kernels ? *kernels : select(); }
+  static Variant currentVariant();
+
+  /// true if the variant was compiled in and this cpu can run it
+  static bool isSupported( Variant variant );
+  /// the kernels for a variant, or 0 if it isn't supported
+  static const Kernels *kernels( Variant variant );
+  /// switches every fitness function to a variant, for testing and benchmarking. returns false if it isn't supported
+  static bool setVariant( Variant variant );
+
+  /// baseline, sse4.1, avx2 or avx512
+  static QString variantName( Variant variant );
+  /// the variant with a name, or VariantCount if there isn't one
+  static Variant variantFromName( const QString &name );
+
+  /// runs every supported variant over the same rows, of awkward widths, and checks that they all agree
+  /// with the baseline. describes the first mismatch in failure, if there is one
+  static bool selfCheck( QString *failure = 0 );
+
+private:
+  /// picks the variant to use, and sets s_current
+  static const Kernels &select();
+
+  static QAtomicPointer< const Kernels > s_current;
+};
+
+#endif // FITNESSKERNELS_H
@@ -0,0 +1,80 @@
+#include "flameplugin.h"
+
+#include "tracer.h"
+
+FlameSceneType::FlameSceneType()
+  : m_openCL( 0 )
+{
+}
+
+FlameSceneType::~FlameSceneType()
+{
+  delete m_openCL;
+}
+
+bool FlameSceneType::initialise( const EvolutionParameters &params, int maxThreads )
+{
+  EmberScene::Backend backend = params.flameBackend == EvolutionParameters::CpuBackend ? EmberScene::CpuBackend : EmberScene::OpenCLBackend;
+  return EmberScene::initialiseRenderer( params.palettesFile, backend, params.openclPlatform, params.openclDevice, maxThreads );
+}
+
+void FlameSceneType::shutdown()
+{
+  EmberScene::destroyRenderer();
+}
+
+bool FlameSceneType::isInitialised() const
+{
+  return EmberScene::isRendererInitialised();
+}
+
+AbstractScene *FlameSceneType::createScene( const EvolutionParameters &params, int width, int height ) const
+{
+  return new EmberScene( width, height, params.maxXforms );
+}
+
+AbstractScene *FlameSceneType::createEmptyScene( const EvolutionParameters &params, int width, int height ) const
+{
+  return new EmberScene( width, height, params.maxXforms, false );
+}
+
+QStringList FlameSceneType::platforms()
+{
+  QStringList names;
+  foreach( std::string platform, openCL()->PlatformNames() )
+    names << QString::fromStdString( platform );
+  return names;
+}
+
+QStringList FlameSceneType::devices( int platform )
+{
+  QStringList names;
+  foreach( std::string device, openCL()->DeviceNames( platform ) )
+    names << QString::fromStdString( device );
+  return names;
+}
+
+EmberCLns::OpenCLWrapper *FlameSceneType::openCL()
+{
+  if ( ! m_openCL )
+  {
+    m_openCL = new EmberCLns::OpenCLWrapper;
+    m_openCL->CheckOpenCL();
+  }
+  return m_openCL;
+}
+
+QList< SceneType* > FlamePlugin::sceneTypes()
+{
+  return QList< SceneType* >() << &m_flames;
+}
+
+void FlamePlugin::setTracer( Tracer *tracer )
+{
+  Tracer::setInstance( tracer );
+}
+
+void FlamePlugin::setRandomiser( Randomiser::Source source )
+{
+  Randomiser::setSource( source );
+}
@@ -0,0 +1,55 @@
+#ifndef FLAMEPLUGIN_H
+#define FLAMEPLUGIN_H
+
+#include <QObject>
+
+#include "sceneplugin.h"
+#include "emberscene.h"
+
+/** Flame scenes, rendered by Ember. Lives in a plugin so that only builds which want flames
+    need Fractorium, OpenCL and libxml2 */
+
+class FlameSceneType : public SceneType
+{
+public:
+  FlameSceneType();
+  virtual ~FlameSceneType();
+
+  virtual QString name() const { return "flames"; }
+
+  virtual bool initialise( const EvolutionParameters &params, int maxThreads );
+  virtual void shutdown();
+  virtual bool isInitialised() const;
+
+  virtual AbstractScene *createScene( const EvolutionParameters &params, int width, int height ) const;
+  virtual AbstractScene *createEmptyScene( const EvolutionParameters &params, int width, int height ) const;
+
+  /// flame scenes are serialised as xml, which is too slow to do on every improvement
+  virtual bool logsScenes() const { return false; }
+
+  virtual QStringList platforms();
+  virtual QStringList devices( int platform );
+
+private:
+  /// probes for opencl the first time the devices are asked for, rather than at startup
+  EmberCLns::OpenCLWrapper *openCL();
+
+  EmberCLns::OpenCLWrapper *m_openCL;
+};
+
+class FlamePlugin : public QObject, public TrianglesPlugin
+{
+  Q_OBJECT
+  Q_PLUGIN_METADATA( IID TrianglesPlugin_iid )
+  Q_INTERFACES( TrianglesPlugin )
+
+public:
+  virtual QList< SceneType* > sceneTypes();
+  virtual void setTracer( Tracer *tracer );
+  virtual void setRandomiser( Randomiser::Source source );
+
+private:
+  FlameSceneType m_flames;
+};
+
+#endif // FLAMEPLUGIN_H
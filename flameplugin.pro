@@ -0,0 +1,70 @@
+#-------------------------------------------------
+#
+# Flame scenes, as a plugin. Only this needs Fractorium (Ember, EmberCL),
+# OpenCL and libxml2, so the triangles builds run without them:
+#
+#   qmake flameplugin.pro -o Makefile.flames && make -f Makefile.flames
+#
+# The plugin is written to plugins/, where triangles and triangles-cli
+# look for it (as does anything on TRIANGLES_PLUGIN_PATH)
+#
+#-------------------------------------------------
+
+include(common.pri)
+
+QT       += core gui concurrent
+
+TEMPLATE = lib
+CONFIG += plugin
+TARGET = $$qtLibraryTarget(flamescenes)
+DESTDIR = plugins
+
+OBJECTS_DIR = .obj-flames
+MOC_DIR = .moc-flames
+
+FRACTORIUM_DIR = $$(HOME)/Dev/fractorium/Bin
+debug:FRACTORIUM_DIR = $$(HOME)/Dev/fractorium/Dbg
+
+LIBS += -L$$FRACTORIUM_DIR -lEmber
+LIBS += -L$$FRACTORIUM_DIR -lEmberCL
+
+LIBS += -lxml2
+
+macx {
+  LIBS += -framework OpenGL
+  LIBS += -framework OpenCL
+
+  INCLUDEPATH += $$PWD/fractorium/Deps
+}
+
+linux-g++ {
+  LIBS += -lOpenCL
+}
+
+QMAKE_CXXFLAGS += -DCL_USE_DEPRECATED_OPENCL_1_1_APIS
+
+INCLUDEPATH += $$PWD/fractorium/Source/Ember
+INCLUDEPATH += $$PWD/fractorium/Source/EmberCL
+INCLUDEPATH += $$PWD/fractorium/Source/EmberCommon
+
+INCLUDEPATH += /usr/include/libxml2
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# the scene base class, the random numbers and the tracer are compiled in too, as the executables don't export them
+SOURCES += \
+    flameplugin.cpp \
+    emberscene.cpp \
+    abstractscene.cpp \
+    randomiser.cpp \
+    tracer.cpp
+
+HEADERS += \
+    flameplugin.h \
+    emberscene.h \
+    abstractscene.h \
+    randomiser.h \
+    tracer.h \
+    sceneplugin.h \
+    x11_undefs.h
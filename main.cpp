@@ -1,10 +1,22 @@
 #include "triangles.h"
+#include "tracer.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // TRIANGLES_TRACE=file.json records a timeline of the last few thousand tasks on each thread, written on exit
+    QString tracePath( qgetenv( "TRIANGLES_TRACE" ) );
+    if ( ! tracePath.isEmpty() )
+        Tracer::instance().start();
+
     Triangles w;
     w.show();
-    return a.exec();
+    int result = a.exec();
+
+    if ( ! tracePath.isEmpty() && ! Tracer::instance().write( tracePath ) )
+        qWarning( "Couldn't write the trace to %s", qPrintable( tracePath ) );
+
+    return result;
 }
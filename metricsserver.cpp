@@ -0,0 +1,314 @@
+#include "metricsserver.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QHostAddress>
+#include <QThreadPool>
+#include <QFile>
+#include <QTextStream>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+MetricsServer::MetricsServer()
+  : m_listener( 0 )
+  , m_hasQueue( false )
+  , m_pending( 0 )
+  , m_ready( 0 )
+  , m_runningSlices( 0 )
+  , m_completed( 0 )
+  , m_failed( 0 )
+{
+  m_thread.setObjectName( "metrics" );
+}
+
+MetricsServer::~MetricsServer()
+{
+  if ( m_listener )
+  {
+    QMetaObject::invokeMethod( m_listener, "close", Qt::BlockingQueuedConnection );
+    m_thread.quit();
+    m_thread.wait();
+    delete m_listener;
+  }
+}
+
+bool MetricsServer::listen( const QString &address )
+{
+  if ( ! m_listener )
+  {
+    m_listener = new MetricsListener( this );
+    m_listener->moveToThread( &m_thread );
+    m_thread.start();
+  }
+
+  bool listening = false;
+  QMetaObject::invokeMethod( m_listener, "listen", Qt::BlockingQueuedConnection, Q_RETURN_ARG( bool, listening ), Q_ARG( QString, address ) );
+  if ( ! listening )
+    QMetaObject::invokeMethod( m_listener, "errorString", Qt::BlockingQueuedConnection, Q_RETURN_ARG( QString, m_error ) );
+  return listening;
+}
+
+void MetricsServer::publish( const QString &run, const EvolutionSnapshot &snapshot )
+{
+  Run r;
+  r.generations = snapshot.totalGenerations;
+  r.evaluations = snapshot.phases.evaluations;
+  r.allocations = snapshot.phases.allocations;
+  r.cacheLookups = snapshot.phases.cacheLookups;
+  r.cacheHits = snapshot.phases.cacheHits;
+  r.iterationsPerSec = snapshot.iterationsPerSec;
+  r.evaluationsPerSec = snapshot.evaluationsPerSec;
+  r.bestFitness = snapshot.bestFitness;
+  r.currentFitness = snapshot.currentFitness;
+  r.acceptCount = snapshot.acceptCount;
+  r.improvements = snapshot.improvements;
+  r.age = snapshot.age;
+  r.culture = snapshot.culture;
+  r.maxCultures = snapshot.maxCultures;
+  r.iterations = snapshot.iterations;
+  r.maxIterations = snapshot.maxIterations;
+  r.screened = snapshot.screening.screened;
+  r.screenRejected = snapshot.screening.rejected;
+  for( int phase = 0; phase < PhaseStats::PhaseCount; ++ phase )
+    r.phaseNsecs[phase] = snapshot.phases.nsecs[phase];
+
+  QMutexLocker locker( &m_mutex );
+  m_runs.insert( run, r );
+}
+
+void MetricsServer::remove( const QString &run )
+{
+  QMutexLocker locker( &m_mutex );
+  m_runs.remove( run );
+}
+
+void MetricsServer::publishQueue( int pending, int ready, int runningSlices, int completed, int failed )
+{
+  QMutexLocker locker( &m_mutex );
+  m_hasQueue = true;
+  m_pending = pending;
+  m_ready = ready;
+  m_runningSlices = runningSlices;
+  m_completed = completed;
+  m_failed = failed;
+}
+
+namespace
+{
+
+/// writes the help and type lines for a metric
+void describe( QTextStream &ts, const char *name, const char *type, const char *help )
+{
+  ts << "# HELP " << name << " " << help << "\n";
+  ts << "# TYPE " << name << " " << type << "\n";
+}
+
+/// a run name as a label value, with the characters prometheus needs escaped
+QString label( const QString &run )
+{
+  QString escaped( run );
+  escaped.replace( "\\", "\\\\" ).replace( "\"", "\\\"" ).replace( "\n", "\\n" );
+  return "{run=\"" + escaped + "\"}";
+}
+
+}
+
+QByteArray MetricsServer::render() const
+{
+  // copied out, so the lock is only held for the copy and not while the text is written
+  QHash< QString, Run > runs;
+  bool hasQueue;
+  int pending, ready, runningSlices, completed, failed;
+  {
+    QMutexLocker locker( &m_mutex );
+    runs = m_runs;
+    hasQueue = m_hasQueue;
+    pending = m_pending;
+    ready = m_ready;
+    runningSlices = m_runningSlices;
+    completed = m_completed;
+    failed = m_failed;
+  }
+
+  QByteArray text;
+  QTextStream ts( &text );
+
+  // each metric gets its help once, followed by a line per run
+#define RUN_METRIC( name, type, help, field ) \
+  describe( ts, name, type, help ); \
+  for( QHash< QString, Run >::const_iterator i = runs.constBegin(); i != runs.constEnd(); ++ i ) \
+    ts << name << label( i.key() ) << " " << i.value().field << "\n";
+
+  RUN_METRIC( "triangles_generations_total", "counter", "Generations run, across all cultures and ages.", generations )
+  RUN_METRIC( "triangles_evaluations_total", "counter", "Scenes given a full render and score.", evaluations )
+  RUN_METRIC( "triangles_allocations_total", "counter", "Scenes and render buffers created.", allocations )
+  RUN_METRIC( "triangles_fitness_cache_lookups_total", "counter", "Children looked up in the fitness cache.", cacheLookups )
+  RUN_METRIC( "triangles_fitness_cache_hits_total", "counter", "Children that reused a known fitness rather than being evaluated.", cacheHits )
+  RUN_METRIC( "triangles_generations_per_second", "gauge", "Generations per second in the current culture.", iterationsPerSec )
+  RUN_METRIC( "triangles_evaluations_per_second", "gauge", "Full evaluations per second of active time.", evaluationsPerSec )
+  RUN_METRIC( "triangles_best_fitness", "gauge", "Best fitness so far. Lower is better.", bestFitness )
+  RUN_METRIC( "triangles_current_fitness", "gauge", "Best fitness in the current culture.", currentFitness )
+  RUN_METRIC( "triangles_culture_accepted", "gauge", "Children accepted into the pool in the current culture.", acceptCount )
+  RUN_METRIC( "triangles_culture_improvements", "gauge", "Improvements in the current culture.", improvements )
+  RUN_METRIC( "triangles_age", "gauge", "Current age.", age )
+  RUN_METRIC( "triangles_culture", "gauge", "Current culture within the age.", culture )
+  RUN_METRIC( "triangles_cultures", "gauge", "Cultures in the current age.", maxCultures )
+  RUN_METRIC( "triangles_culture_generation", "gauge", "Generation within the current culture.", iterations )
+  RUN_METRIC( "triangles_culture_generations", "gauge", "Generations in the current culture, or 0 if it runs until stopped.", maxIterations )
+  RUN_METRIC( "triangles_screened_total", "counter", "Children given a preview render.", screened )
+  RUN_METRIC( "triangles_screen_rejected_total", "counter", "Children ruled out by their preview.", screenRejected )
+
+#undef RUN_METRIC
+
+  describe( ts, "triangles_phase_seconds_total", "counter", "Time spent in each phase of the evolution loop." );
+  for( QHash< QString, Run >::const_iterator i = runs.constBegin(); i != runs.constEnd(); ++ i )
+  {
+    QString runLabel( label( i.key() ) );
+    runLabel.chop( 1 );
+    for( int phase = 0; phase < PhaseStats::PhaseCount; ++ phase )
+      ts << "triangles_phase_seconds_total" << runLabel << ",phase=\"" << PhaseStats::phaseName( phase ) << "\"} " << i.value().phaseNsecs[phase] / 1e9 << "\n";
+  }
+
+  if ( hasQueue )
+  {
+    describe( ts, "triangles_jobs", "gauge", "Batch jobs waiting to start, waiting for a slice, and running a slice." );
+    ts << "triangles_jobs{state=\"pending\"} " << pending << "\n";
+    ts << "triangles_jobs{state=\"ready\"} " << ready << "\n";
+    ts << "triangles_jobs{state=\"running\"} " << runningSlices << "\n";
+    describe( ts, "triangles_jobs_finished_total", "counter", "Batch jobs that have ended." );
+    ts << "triangles_jobs_finished_total{result=\"completed\"} " << completed << "\n";
+    ts << "triangles_jobs_finished_total{result=\"failed\"} " << failed << "\n";
+  }
+
+  QThreadPool *pool = QThreadPool::globalInstance();
+  describe( ts, "triangles_threads_active", "gauge", "Worker threads busy in the global pool." );
+  ts << "triangles_threads_active " << pool->activeThreadCount() << "\n";
+  describe( ts, "triangles_threads_max", "gauge", "Size of the global pool." );
+  ts << "triangles_threads_max " << pool->maxThreadCount() << "\n";
+
+  qint64 resident = residentBytes();
+  if ( resident >= 0 )
+  {
+    describe( ts, "triangles_resident_memory_bytes", "gauge", "Resident memory of the process." );
+    ts << "triangles_resident_memory_bytes " << resident << "\n";
+  }
+
+  ts.flush();
+  return text;
+}
+
+qint64 MetricsServer::residentBytes()
+{
+#ifdef Q_OS_LINUX
+  // the second field of statm is the resident set, in pages
+  QFile statm( "/proc/self/statm" );
+  if ( ! statm.open( QFile::ReadOnly ) )
+    return -1;
+
+  QList< QByteArray > fields( statm.readAll().split( ' ' ) );
+  if ( fields.count() < 2 )
+    return -1;
+
+  return fields.at( 1 ).toLongLong() * sysconf( _SC_PAGESIZE );
+#else
+  return -1;
+#endif
+}
+
+MetricsListener::MetricsListener( const MetricsServer *server )
+  : m_server( server )
+  , m_tcpServer( 0 )
+  , m_localServer( 0 )
+{
+}
+
+bool MetricsListener::listen( const QString &address )
+{
+  close();
+
+  bool isPort = false;
+  quint16 port = address.toUShort( &isPort );
+  if ( isPort )
+  {
+    // localhost only. anything wider is a job for whatever proxies the scrape
+    m_tcpServer = new QTcpServer( this );
+    connect( m_tcpServer, SIGNAL( newConnection() ), this, SLOT( newTcpConnection() ) );
+    return m_tcpServer->listen( QHostAddress::LocalHost, port );
+  }
+
+  m_localServer = new QLocalServer( this );
+  connect( m_localServer, SIGNAL( newConnection() ), this, SLOT( newLocalConnection() ) );
+  QLocalServer::removeServer( address );
+  return m_localServer->listen( address );
+}
+
+QString MetricsListener::errorString() const
+{
+  if ( m_tcpServer )
+    return m_tcpServer->errorString();
+  if ( m_localServer )
+    return m_localServer->errorString();
+  return QString();
+}
+
+void MetricsListener::close()
+{
+  delete m_tcpServer;
+  m_tcpServer = 0;
+  delete m_localServer;
+  m_localServer = 0;
+}
+
+void MetricsListener::newTcpConnection()
+{
+  while( QTcpSocket *client = m_tcpServer->nextPendingConnection() )
+    accept( client );
+}
+
+void MetricsListener::newLocalConnection()
+{
+  while( QLocalSocket *client = m_localServer->nextPendingConnection() )
+    accept( client );
+}
+
+void MetricsListener::accept( QIODevice *client )
+{
+  connect( client, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+  connect( client, SIGNAL( disconnected() ), client, SLOT( deleteLater() ) );
+}
+
+void MetricsListener::readRequest()
+{
+  QIODevice *client = qobject_cast< QIODevice* > ( sender() );
+  if ( ! client || ! client->canReadLine() )
+    return;
+
+  // only the request line matters. the headers are left unread, as the connection is closed after the reply
+  QList< QByteArray > request( client->readLine().trimmed().split( ' ' ) );
+  disconnect( client, SIGNAL( readyRead() ), this, SLOT( readRequest() ) );
+
+  QByteArray status( "200 OK" );
+  QByteArray body;
+  if ( request.count() < 2 || request.at( 0 ) != "GET" )
+    status = "405 Method Not Allowed";
+  else if ( request.at( 1 ) != "/metrics" && request.at( 1 ) != "/" )
+    status = "404 Not Found";
+  else
+    body = m_server->render();
+
+  QByteArray reply( "HTTP/1.0 " + status + "\r\n" );
+  reply += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+  reply += "Content-Length: " + QByteArray::number( body.size() ) + "\r\n";
+  reply += "Connection: close\r\n\r\n";
+  reply += body;
+  client->write( reply );
+
+  if ( QTcpSocket *tcp = qobject_cast< QTcpSocket* > ( client ) )
+    tcp->disconnectFromHost();
+  else if ( QLocalSocket *local = qobject_cast< QLocalSocket* > ( client ) )
+    local->disconnectFromServer();
+}
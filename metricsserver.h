@@ -0,0 +1,118 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+
+#include "evolutionsnapshot.h"
+
+class QTcpServer;
+class QLocalServer;
+class QIODevice;
+class MetricsListener;
+
+/** Serves the progress of every run in the process as Prometheus text metrics, over HTTP on a
+    localhost port or a unix socket. It answers requests on a thread of its own, so it keeps
+    serving while the evolution loop, or a command-line driver with no event loop, is busy.
+
+    Engines push their numbers here each time they publish a snapshot. Doing so takes this server's
+    lock just long enough to store them, and the evolution loop itself is never waited on */
+
+class MetricsServer
+{
+public:
+  MetricsServer();
+  ~MetricsServer();
+
+  /// starts serving. address is a port number, for http on localhost, or anything else for a unix
+  /// socket at that path. returns false if it couldn't be listened on
+  bool listen( const QString &address );
+  QString errorString() const { return m_error; }
+
+  /// stores the latest progress of a run. safe to call from any thread
+  void publish( const QString &run, const EvolutionSnapshot &snapshot );
+  /// forgets a run that has finished, so a long batch doesn't pile up series for every image
+  void remove( const QString &run );
+  /// stores how deep the batch queues are, and how many jobs have ended
+  void publishQueue( int pending, int ready, int runningSlices, int completed, int failed );
+
+  /// the metrics as Prometheus text. safe to call from any thread
+  QByteArray render() const;
+
+private:
+  Q_DISABLE_COPY( MetricsServer )
+
+  /// the numbers kept from a run's latest snapshot. the images in the snapshot aren't kept, as holding
+  /// on to them would make the engine copy its candidates the next time it draws into them
+  struct Run
+  {
+    quint64 generations;
+    quint64 evaluations;
+    quint64 allocations;
+    quint64 cacheLookups;
+    quint64 cacheHits;
+    float iterationsPerSec;
+    float evaluationsPerSec;
+    float bestFitness;
+    float currentFitness;
+    quint64 acceptCount;
+    int improvements;
+    int age;
+    int culture;
+    int maxCultures;
+    int iterations;
+    int maxIterations;
+    quint64 screened;
+    quint64 screenRejected;
+    qint64 phaseNsecs[PhaseStats::PhaseCount];
+  };
+
+  /// resident memory of the process in bytes, or -1 where it can't be read
+  static qint64 residentBytes();
+
+  QThread m_thread;
+  MetricsListener *m_listener;
+  QString m_error;
+
+  mutable QMutex m_mutex;
+  QHash< QString, Run > m_runs;
+  bool m_hasQueue;
+  int m_pending;
+  int m_ready;
+  int m_runningSlices;
+  int m_completed;
+  int m_failed;
+};
+
+/** The part of the metrics server that lives on its thread, answering requests */
+
+class MetricsListener : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit MetricsListener( const MetricsServer *server );
+
+public slots:
+  bool listen( const QString &address );
+  QString errorString() const;
+  void close();
+
+private slots:
+  void newTcpConnection();
+  void newLocalConnection();
+  void readRequest();
+
+private:
+  void accept( QIODevice *client );
+
+  const MetricsServer *m_server;
+  QTcpServer *m_tcpServer;
+  QLocalServer *m_localServer;
+};
+
+#endif // METRICSSERVER_H
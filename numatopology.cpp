@@ -0,0 +1,238 @@
+#include "numatopology.h"
+
+#include <QDir>
+#include <QFile>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QSharedPointer>
+#include <QSemaphore>
+#include <QRunnable>
+#include <QAtomicInt>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+namespace
+{
+
+QThreadStorage< int > s_threadNodes;
+QAtomicInt s_pinned;
+
+/// parses a kernel cpu list, such as "0-15,32-47"
+QList< int > parseCpuList( const QByteArray &text )
+{
+  QList< int > cpus;
+  foreach( const QByteArray &range, text.trimmed().split( ',' ) )
+  {
+    QList< QByteArray > ends( range.split( '-' ) );
+    bool ok = false;
+    int first = ends.first().toInt( &ok );
+    if ( ! ok )
+      continue;
+    int last = ends.count() > 1 ? ends.last().toInt() : first;
+    for( int cpu = first; cpu <= last; ++ cpu )
+      cpus << cpu;
+  }
+  return cpus;
+}
+
+#ifdef Q_OS_LINUX
+/// binds the calling thread to a set of cpus
+bool bindThread( const QList< int > &cpus )
+{
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  foreach( int cpu, cpus )
+    CPU_SET( cpu, &set );
+  return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+}
+#endif
+
+/// a round of tasks, one for every thread of the pool. the tasks share it, as the last of them may
+/// still be waking up after pinPool has returned
+struct Round
+{
+  QSemaphore started;
+  QSemaphore release;
+  /// how many of the round's tasks ran on a thread that isn't pinned
+  QAtomicInt unpinned;
+};
+
+/// pins the thread it runs on to cpu, or with no cpu just checks that it's pinned, then holds it until
+/// every other thread in the pool has a task from the same round, so no two of them share a thread
+class PinTask : public QRunnable
+{
+public:
+  PinTask( int cpu, int node, const QSharedPointer< Round > &round )
+    : m_cpu( cpu )
+    , m_node( node )
+    , m_round( round )
+  {
+  }
+
+  void run()
+  {
+#ifdef Q_OS_LINUX
+    if ( m_cpu >= 0 && bindThread( QList< int >() << m_cpu ) )
+      s_threadNodes.setLocalData( m_node );
+#endif
+    if ( NumaTopology::threadNode() < 0 )
+      m_round->unpinned.ref();
+
+    m_round->started.release();
+    m_round->release.acquire();
+  }
+
+private:
+  int m_cpu;
+  int m_node;
+  QSharedPointer< Round > m_round;
+};
+
+/// starts a round of tasks, one per thread, and lets them go once they've all started
+void runRound( QThreadPool *pool, const QSharedPointer< Round > &round, const QList< QRunnable* > &tasks )
+{
+  foreach( QRunnable *task, tasks )
+    pool->start( task );
+
+  round->started.acquire( tasks.count() );
+  round->release.release( tasks.count() );
+}
+
+QList< QList< int > > readNodes()
+{
+  QList< QList< int > > nodes;
+  QList< int > allowed;
+#ifdef Q_OS_LINUX
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  if ( sched_getaffinity( 0, sizeof( set ), &set ) == 0 )
+  {
+    for( int cpu = 0; cpu < CPU_SETSIZE; ++ cpu )
+    {
+      if ( CPU_ISSET( cpu, &set ) )
+        allowed << cpu;
+    }
+  }
+
+  // nodes are numbered in order, but not necessarily without gaps. memory-only nodes, and nodes whose
+  // cpus the process has been kept off, are left out
+  QDir nodeDir( "/sys/devices/system/node" );
+  QStringList nodeNames( nodeDir.entryList( QStringList() << "node*", QDir::Dirs ) );
+  QList< int > nodeNumbers;
+  foreach( const QString &name, nodeNames )
+    nodeNumbers << name.mid( 4 ).toInt();
+  std::sort( nodeNumbers.begin(), nodeNumbers.end() );
+
+  foreach( int number, nodeNumbers )
+  {
+    QFile file( nodeDir.absoluteFilePath( QString( "node%1/cpulist" ).arg( number ) ) );
+    if ( ! file.open( QIODevice::ReadOnly ) )
+      continue;
+
+    QList< int > cpus;
+    foreach( int cpu, parseCpuList( file.readAll() ) )
+    {
+      if ( allowed.contains( cpu ) )
+        cpus << cpu;
+    }
+    if ( ! cpus.isEmpty() )
+      nodes << cpus;
+  }
+#endif
+
+  if ( nodes.isEmpty() )
+    nodes << allowed;
+
+  return nodes;
+}
+
+}
+
+const QList< QList< int > > &NumaTopology::nodes()
+{
+  static const QList< QList< int > > s_nodes( readNodes() );
+  return s_nodes;
+}
+
+int NumaTopology::nodeCount()
+{
+  return nodes().count();
+}
+
+QList< int > NumaTopology::cpus( int node )
+{
+  return nodes().value( node );
+}
+
+bool NumaTopology::pinPool( QThreadPool *pool )
+{
+#ifdef Q_OS_LINUX
+  const QList< QList< int > > &all( nodes() );
+  if ( all.first().isEmpty() )
+    return false;
+
+  pool->setExpiryTimeout( -1 );
+
+  // worker i goes to node i % nodes, on that node's cpus in order. the kernel lists a node's physical
+  // cores before their hyperthreads, so the second thread on a core is the last to be given out
+  int threads = pool->maxThreadCount();
+  QSharedPointer< Round > pin( new Round );
+  QList< QRunnable* > pinTasks;
+  for( int i = 0; i < threads; ++ i )
+  {
+    int node = i % all.count();
+    const QList< int > &cpus( all[node] );
+    pinTasks << new PinTask( cpus[( i / all.count() ) % cpus.count()], node, pin );
+  }
+  runRound( pool, pin, pinTasks );
+
+  // the pool is never waited on, as waiting for it to finish deletes its threads, and their affinity
+  // with them. the threads never expire either, so every later task runs on one of the pinned threads.
+  // a second round checks that's so
+  QSharedPointer< Round > check( new Round );
+  QList< QRunnable* > checkTasks;
+  for( int i = 0; i < threads; ++ i )
+    checkTasks << new PinTask( -1, -1, check );
+  runRound( pool, check, checkTasks );
+  if ( pin->unpinned.load() || check->unpinned.load() )
+    return false;
+
+  s_pinned.storeRelease( 1 );
+  return true;
+#else
+  Q_UNUSED( pool );
+  return false;
+#endif
+}
+
+bool NumaTopology::isPinned()
+{
+  return s_pinned.loadAcquire() != 0;
+}
+
+int NumaTopology::threadNode()
+{
+  return s_threadNodes.hasLocalData() ? s_threadNodes.localData() : -1;
+}
+
+void NumaTopology::runOnNode( int node, const std::function< void() > &fn )
+{
+#ifdef Q_OS_LINUX
+  cpu_set_t previous;
+  bool saved = pthread_getaffinity_np( pthread_self(), sizeof( previous ), &previous ) == 0;
+  bool bound = saved && bindThread( cpus( node ) );
+
+  fn();
+
+  if ( bound )
+    pthread_setaffinity_np( pthread_self(), sizeof( previous ), &previous );
+#else
+  Q_UNUSED( node );
+  fn();
+#endif
+}
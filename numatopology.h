@@ -0,0 +1,43 @@
+#ifndef NUMATOPOLOGY_H
+#define NUMATOPOLOGY_H
+
+#include <QList>
+#include <functional>
+
+class QThreadPool;
+
+/** Which cpus belong to which NUMA node, and which node each worker thread is pinned to. The nodes are
+    read from /sys once. Anything that isn't linux, or doesn't have more than one node, is treated as one
+    node holding every cpu the process may run on.
+
+    Pinning only pays off if the data the workers read on every evaluation is on their own node, so the
+    fitness functions keep a replica of the target per node (see AbstractFitness::replicate()). Scratch
+    buffers are allocated and first written by the worker that uses them, which puts them on its node */
+
+class NumaTopology
+{
+public:
+  /// the number of nodes with cpus the process may run on
+  static int nodeCount();
+  /// the cpus of a node, numbered as the kernel numbers them
+  static QList< int > cpus( int node );
+
+  /// pins each of the pool's threads to a cpu of its own, taking the nodes in turn so even a few
+  /// threads use every node's memory, and stops the threads expiring so they stay pinned. it must be
+  /// called before anything else runs on the pool. returns false if threads can't be pinned here
+  static bool pinPool( QThreadPool *pool );
+  /// true once pinPool has succeeded
+  static bool isPinned();
+  /// the node the calling thread is pinned to, or -1 if it isn't a pinned worker
+  static int threadNode();
+
+  /// runs fn while the calling thread is bound to a node's cpus, so the memory fn touches first is
+  /// allocated on that node. the thread's affinity is put back afterwards
+  static void runOnNode( int node, const std::function< void() > &fn );
+
+private:
+  /// reads the nodes, once
+  static const QList< QList< int > > &nodes();
+};
+
+#endif // NUMATOPOLOGY_H
@@ -0,0 +1,99 @@
+#include "pluginregistry.h"
+
+#include <QCoreApplication>
+#include <QPluginLoader>
+#include <QDir>
+
+#include "trianglescene.h"
+#include "faceweightedpixelsumfitness.h"
+#include "tracer.h"
+#include "randomiser.h"
+
+namespace
+{
+
+class TriangleSceneType : public SceneType
+{
+public:
+  virtual QString name() const { return "triangles"; }
+
+  virtual AbstractScene *createScene( const EvolutionParameters &params, int width, int height ) const
+  {
+    return new TriangleScene( params.triangleCount, width, height, QColor( 255, 255, 255, 255 ) );
+  }
+
+  virtual AbstractScene *createEmptyScene( const EvolutionParameters &params, int width, int height ) const
+  {
+    Q_UNUSED( params ); Q_UNUSED( width ); Q_UNUSED( height );
+    return new TriangleScene( 0, 0, 0, QColor() );
+  }
+};
+
+class FaceWeightedPixelSumFitnessType : public FitnessType
+{
+public:
+  virtual QString name() const { return "faceWeightedPixelSum"; }
+
+  virtual AbstractFitness *createFitness( const TargetImage &target, const EvolutionParameters &params ) const
+  {
+    return new FaceWeightedPixelSumFitness( target, params.faceWeight );
+  }
+};
+
+}
+
+PluginRegistry &PluginRegistry::instance()
+{
+  static PluginRegistry registry;
+  return registry;
+}
+
+PluginRegistry::PluginRegistry()
+{
+  static TriangleSceneType triangles;
+  static FaceWeightedPixelSumFitnessType faceWeightedPixelSum;
+  registerSceneType( &triangles );
+  registerFitnessType( &faceWeightedPixelSum );
+
+  loadPlugins( QCoreApplication::applicationDirPath() + "/plugins" );
+
+  foreach( QString path, QString::fromLocal8Bit( qgetenv( "TRIANGLES_PLUGIN_PATH" ) ).split( ':', QString::SkipEmptyParts ) )
+    loadPlugins( path );
+}
+
+void PluginRegistry::registerSceneType( SceneType *type )
+{
+  m_sceneTypes.insert( type->name(), type );
+}
+
+void PluginRegistry::registerFitnessType( FitnessType *type )
+{
+  m_fitnessTypes.insert( type->name(), type );
+}
+
+void PluginRegistry::loadPlugins( const QString &path )
+{
+  QDir dir( path );
+  if ( ! dir.exists() )
+    return;
+
+  foreach( QString fileName, dir.entryList( QDir::Files ) )
+  {
+    QPluginLoader loader( dir.absoluteFilePath( fileName ) );
+    // plugins are never unloaded, as their types are used until the process exits
+    TrianglesPlugin *plugin = qobject_cast< TrianglesPlugin* > ( loader.instance() );
+    if ( ! plugin )
+    {
+      if ( QLibrary::isLibrary( fileName ) )
+        qWarning( "Couldn't load plugin %s: %s", qPrintable( fileName ), qPrintable( loader.errorString() ) );
+      continue;
+    }
+
+    plugin->setTracer( &Tracer::instance() );
+    plugin->setRandomiser( &Randomiser::randomInt );
+    foreach( SceneType *type, plugin->sceneTypes() )
+      registerSceneType( type );
+    foreach( FitnessType *type, plugin->fitnessTypes() )
+      registerFitnessType( type );
+  }
+}
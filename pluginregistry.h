@@ -0,0 +1,46 @@
+#ifndef PLUGINREGISTRY_H
+#define PLUGINREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include "sceneplugin.h"
+
+/** Every scene and fitness type available to the engine. The triangle scenes and the face-weighted
+    fitness are built in. Anything else (flames) comes from plugins, so builds that don't need them
+    don't link against their libraries.
+
+    Plugins are loaded from the "plugins" directory next to the executable, and from any directories
+    in the TRIANGLES_PLUGIN_PATH environment variable */
+
+class PluginRegistry
+{
+public:
+  /// the registry, loading the plugins the first time it's called
+  static PluginRegistry &instance();
+
+  /// the scene type with the given name, or 0 if there isn't one
+  SceneType *sceneType( const QString &name ) const { return m_sceneTypes.value( name ); }
+  /// the fitness type with the given name, or 0 if there isn't one
+  FitnessType *fitnessType( const QString &name ) const { return m_fitnessTypes.value( name ); }
+
+  QStringList sceneTypeNames() const { return m_sceneTypes.keys(); }
+  QStringList fitnessTypeNames() const { return m_fitnessTypes.keys(); }
+
+  /// adds types. the registry doesn't take ownership
+  void registerSceneType( SceneType *type );
+  void registerFitnessType( FitnessType *type );
+
+  /// loads every plugin in a directory
+  void loadPlugins( const QString &path );
+
+private:
+  PluginRegistry();
+  Q_DISABLE_COPY( PluginRegistry )
+
+  QHash< QString, SceneType* > m_sceneTypes;
+  QHash< QString, FitnessType* > m_fitnessTypes;
+};
+
+#endif // PLUGINREGISTRY_H
@@ -5,6 +5,7 @@
 #include <QColor>
 
 #include "randomiser.h"
+#include "abstractscene.h"
 
 Poly::Poly( int width, int height )
 {
@@ -48,6 +49,14 @@ void Poly::renderTo( QPainter &painter )
   painter.drawPolygon( QPolygon( m_points ) );
 }
 
+quint64 Poly::hash( quint64 seed ) const
+{
+  quint64 h = AbstractScene::combineHash( seed, m_color.rgba() );
+  foreach( const QPoint &point, m_points )
+    h = AbstractScene::combineHash( h, ( quint64( quint32( point.x() ) ) << 32 ) | quint32( point.y() ) );
+  return h;
+}
+
 void Poly::mutate( MutationType mt )
 {
   if( mt < MoveCorner )
@@ -39,6 +39,8 @@ public:
   void mutate( MutationType mutationType );
   /// renders this triange to the specified painter, as part of a scene
   void renderTo( QPainter &painter );
+  /// mixes the corners and colour into a scene's hash
+  quint64 hash( quint64 seed ) const;
 
   /// assigns the data from another triangle to this one
   Poly &operator = ( const Poly &other );
@@ -1,12 +1,71 @@
 #include "randomiser.h"
-#include "mtrand.h"
 
 #include <QDateTime>
+#include <QThreadStorage>
+#include <QAtomicInt>
 #include <qmath.h>
 
+#include <random>
+
+namespace
+{
+
+struct Generator
+{
+  std::mt19937 engine;
+  /// which seed() call the engine was last seeded for
+  int seedGeneration;
+  int thread;
+};
+
+/// bumped by every seed() call. 0 means nothing has been seeded, so the clock is used
+QAtomicInt s_seedGeneration;
+QAtomicInt s_seed;
+/// where the numbers come from instead, if set
+Randomiser::Source s_source = 0;
+
+}
+
 int Randomiser::randomInt( int size )
 {
-  static MTRand mt( QDateTime::currentMSecsSinceEpoch() );
+  if ( s_source )
+    return s_source( size );
 
-  return qFloor( mt() * (double) size );
-}
\ No newline at end of file
+  // the old MTRand port kept its state in statics, which can't be shared between threads that are
+  // all breeding at once. std::mt19937 is the same generator, but one instance per thread
+  static QThreadStorage< Generator* > generators;
+  static QAtomicInt threadCount;
+
+  if ( ! generators.hasLocalData() )
+  {
+    Generator *generator = new Generator;
+    generator->seedGeneration = -1;
+    generator->thread = threadCount.fetchAndAddRelaxed( 1 );
+    generators.setLocalData( generator );
+  }
+
+  Generator *generator = generators.localData();
+  int seedGeneration = s_seedGeneration.loadAcquire();
+  if ( generator->seedGeneration != seedGeneration )
+  {
+    if ( seedGeneration == 0 )
+      generator->engine.seed( QDateTime::currentMSecsSinceEpoch() + generator->thread );
+    else
+      generator->engine.seed( quint32( s_seed.load() ) + generator->thread );
+    generator->seedGeneration = seedGeneration;
+  }
+
+  return qFloor( generator->engine() * ( 1. / 4294967296. ) * (double) size );
+}
+
+void Randomiser::setSource( Source source )
+{
+  // a plugin built into the host already shares this copy, and would only go round in circles
+  s_source = source == &Randomiser::randomInt ? 0 : source;
+}
+
+void Randomiser::seed( quint32 seed )
+{
+  s_seed.store( int( seed ) );
+  s_seedGeneration.fetchAndAddOrdered( 1 );
+}
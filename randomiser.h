@@ -1,10 +1,25 @@
 #ifndef RANDOMISER_H
 #define RANDOMISER_H
 
+#include <QtGlobal>
+
 class Randomiser
 {
 public:
+  /// returns a random number between 0 and size-1. each thread has its own generator,
+  /// so this can be called from anywhere without locking
   static int randomInt( int size );
+
+  /// makes the numbers repeatable. every thread's generator is reseeded from seed, plus a number for
+  /// the thread, the next time it's used. the sequence on any one thread is then the same from run to
+  /// run, but which thread gets which number depends on the order they first asked for one
+  static void seed( quint32 seed );
+
+  /// hands out random numbers the way randomInt does
+  typedef int ( *Source )( int size );
+  /// takes every number from source from now on. plugins are built with their own copy of this class,
+  /// so the host hands them its randomInt, and its seed() reaches them too
+  static void setSource( Source source );
 };
 
 #endif //RANDOMISER_H
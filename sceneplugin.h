@@ -0,0 +1,87 @@
+#ifndef SCENEPLUGIN_H
+#define SCENEPLUGIN_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QImage>
+#include <QtPlugin>
+
+#include "evolutionparameters.h"
+#include "randomiser.h"
+
+class AbstractScene;
+class AbstractFitness;
+class TargetImage;
+class Tracer;
+
+/** A kind of scene that can be evolved, such as triangles or flames. Looked up by name from
+    EvolutionParameters::sceneType */
+
+class SceneType
+{
+public:
+  virtual ~SceneType() {}
+
+  /// the name used for sceneType in the parameters
+  virtual QString name() const = 0;
+
+  /// sets up anything every scene of this type shares, such as a renderer. maxThreads is the most
+  /// threads that will be rendering at once
+  virtual bool initialise( const EvolutionParameters &params, int maxThreads ) { Q_UNUSED( params ); Q_UNUSED( maxThreads ); return true; }
+  /// releases whatever initialise() set up
+  virtual void shutdown() {}
+  /// true if initialise() has been called, and shutdown() hasn't
+  virtual bool isInitialised() const { return true; }
+
+  /// creates a new, random scene
+  virtual AbstractScene *createScene( const EvolutionParameters &params, int width, int height ) const = 0;
+  /// creates a placeholder scene, as cheaply as possible, for when there's no best scene yet
+  virtual AbstractScene *createEmptyScene( const EvolutionParameters &params, int width, int height ) const = 0;
+
+  /// whether scenes are cheap enough to serialise into the culture and age logs on every improvement
+  virtual bool logsScenes() const { return true; }
+
+  /// rendering platforms the user can pick from, if the scenes have a choice of devices to render on
+  virtual QStringList platforms() { return QStringList(); }
+  /// rendering devices on a platform
+  virtual QStringList devices( int platform ) { Q_UNUSED( platform ); return QStringList(); }
+};
+
+/** A way of measuring how close a rendered scene is to the target. Looked up by name from
+    EvolutionParameters::fitnessType */
+
+class FitnessType
+{
+public:
+  virtual ~FitnessType() {}
+
+  /// the name used for fitnessType in the parameters
+  virtual QString name() const = 0;
+
+  /// creates a fitness function for a target
+  virtual AbstractFitness *createFitness( const TargetImage &target, const EvolutionParameters &params ) const = 0;
+};
+
+/** The interface exported by plugin libraries. The plugin keeps ownership of its types, which live
+    as long as the plugin does (which is the life of the process) */
+
+class TrianglesPlugin
+{
+public:
+  virtual ~TrianglesPlugin() {}
+
+  virtual QList< SceneType* > sceneTypes() = 0;
+  virtual QList< FitnessType* > fitnessTypes() { return QList< FitnessType* >(); }
+
+  /// called on loading with the host's tracer, for plugins that record events of their own
+  virtual void setTracer( Tracer *tracer ) { Q_UNUSED( tracer ); }
+  /// called on loading with the host's random number source, so the host's seed reaches the plugin's scenes
+  virtual void setRandomiser( Randomiser::Source source ) { Q_UNUSED( source ); }
+};
+
+#define TrianglesPlugin_iid "net.triangles.TrianglesPlugin/1.5"
+
+Q_DECLARE_INTERFACE( TrianglesPlugin, TrianglesPlugin_iid )
+
+#endif // SCENEPLUGIN_H
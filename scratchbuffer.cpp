@@ -0,0 +1,49 @@
+#include "scratchbuffer.h"
+
+#include <QThreadStorage>
+#include <QVector>
+
+static void freeAligned( void *data )
+{
+  qFreeAligned( data );
+}
+
+static QThreadStorage< QVector< QImage > > s_buffers;
+
+QImage &ScratchBuffer::forThread( const QSize &size, QImage::Format format, int slot, bool *allocated )
+{
+  QVector< QImage > &buffers = s_buffers.localData();
+  if ( buffers.size() <= slot )
+    buffers.resize( slot + 1 );
+
+  QImage &image = buffers[slot];
+  if ( image.size() != size || image.format() != format )
+  {
+    // release the old buffer before allocating the new one
+    image = QImage();
+    image = allocate( size, format );
+    if ( allocated )
+      *allocated = true;
+  }
+
+  return image;
+}
+
+void ScratchBuffer::releaseForThread( int firstSlot )
+{
+  if ( ! s_buffers.hasLocalData() )
+    return;
+
+  QVector< QImage > &buffers = s_buffers.localData();
+  if ( buffers.size() > firstSlot )
+    buffers.resize( firstSlot );
+}
+
+QImage ScratchBuffer::allocate( const QSize &size, QImage::Format format )
+{
+  int depth = QImage( 1, 1, format ).depth();
+  int bytesPerLine = ( ( size.width() * depth / 8 ) + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+  uchar *data = static_cast< uchar* > ( qMallocAligned( bytesPerLine * size.height(), ALIGNMENT ) );
+
+  return QImage( data, size.width(), size.height(), bytesPerLine, format, freeAligned, data );
+}
@@ -0,0 +1,30 @@
+#ifndef SCRATCHBUFFER_H
+#define SCRATCHBUFFER_H
+
+#include <QImage>
+
+/** Per-thread images for rendering candidates into. Each worker thread keeps its own, so evaluating
+    a child allocates nothing and never copies the target just to paint over it. The pixel data is
+    aligned to a cache line, with every scanline padded to one, so the fitness loops start every row
+    on a fresh line. Pages are placed by whichever thread first writes them, which for these is the
+    worker that owns them, so a pinned worker's buffers are on its own NUMA node.
+
+    Nothing else may hold a copy of a scratch image, or the next render would detach it */
+
+class ScratchBuffer
+{
+public:
+  /// the calling thread's scratch image for a slot, with the given size and format. its contents are
+  /// whatever the last render left there. different slots (say, full size and preview) don't
+  /// reallocate each other. if allocated isn't 0, it's set when the image had to be (re)allocated
+  static QImage &forThread( const QSize &size, QImage::Format format, int slot = 0, bool *allocated = 0 );
+  /// frees the calling thread's scratch images from firstSlot on
+  static void releaseForThread( int firstSlot );
+
+  /// allocates an image with the same alignment, for buffers that are kept somewhere other than per thread
+  static QImage allocate( const QSize &size, QImage::Format format );
+
+  static const int ALIGNMENT = 64;
+};
+
+#endif // SCRATCHBUFFER_H
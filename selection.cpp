@@ -0,0 +1,156 @@
+#include "selection.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "randomiser.h"
+
+namespace
+{
+
+/// orders indices by their keys. ties go to the lower index, so the order doesn't depend on how the sort gets there
+struct Better
+{
+  explicit Better( const float *k ) : keys( k ) {}
+  bool operator()( int a, int b ) const { return keys[a] < keys[b] || ( keys[a] == keys[b] && a < b ); }
+  const float *keys;
+};
+
+}
+
+Selection::Selection( EvolutionParameters::SelectionMethod method, int survivors, int tournamentSize )
+  : m_method( method )
+  , m_survivors( survivors )
+  , m_tournamentSize( qMax( 1, tournamentSize ) )
+{
+}
+
+void Selection::select( const QVector< float > &keys, QVector< int > &chosen )
+{
+  chosen.clear();
+  if ( keys.isEmpty() )
+    return;
+
+  switch( m_method )
+  {
+  case EvolutionParameters::TournamentSelection:
+    selectByTournament( keys, chosen );
+    break;
+  case EvolutionParameters::TruncationSelection:
+    selectByTruncation( keys, chosen );
+    break;
+  case EvolutionParameters::RankSelection:
+    selectByRank( keys, chosen );
+    break;
+  default:
+    selectFromTop( keys, chosen );
+  }
+}
+
+int Selection::worstSurvivingRank( int count ) const
+{
+  switch( m_method )
+  {
+  case EvolutionParameters::TruncationSelection:
+    return qMin( m_survivors, count ) - 1;
+  case EvolutionParameters::TournamentSelection:
+  case EvolutionParameters::RankSelection:
+    return count - 1;
+  default:
+    return qMin( m_survivors + m_tournamentSize - 2, count - 1 );
+  }
+}
+
+void Selection::resetOrder( int count )
+{
+  m_order.resize( count );
+  for( int i = 0; i < count; ++ i )
+    m_order[i] = i;
+}
+
+void Selection::selectFromTop( const QVector< float > &keys, QVector< int > &chosen )
+{
+  // nothing below this rank can be picked, so only this many need putting in order
+  int count = keys.size();
+  int ranked = worstSurvivingRank( count ) + 1;
+  resetOrder( count );
+  std::partial_sort( m_order.begin(), m_order.begin() + ranked, m_order.end(), Better( keys.constData() ) );
+
+  chosen << m_order[0];
+  m_order.resize( ranked );
+  m_order.remove( 0 );
+  for( int i = 1; i < m_survivors && ! m_order.isEmpty(); ++ i )
+  {
+    // take candidates at random from the best n left (where n is the tournament size) to keep the gene pool more varied
+    int pick = Randomiser::randomInt( qMin( m_tournamentSize, m_order.size() ) );
+    chosen << m_order[pick];
+    m_order.remove( pick );
+  }
+}
+
+void Selection::selectByTournament( const QVector< float > &keys, QVector< int > &chosen )
+{
+  Better better( keys.constData() );
+  resetOrder( keys.size() );
+
+  // the best is taken out first, and the rest of m_order is the candidates still in the running.
+  // winners are swapped out to the end, so each survives only once
+  std::iter_swap( m_order.begin(), std::min_element( m_order.begin(), m_order.end(), better ) );
+  chosen << m_order[0];
+
+  int alive = m_order.size();
+  for( int i = 1; i < m_survivors && alive > 1; ++ i )
+  {
+    int winner = 1 + Randomiser::randomInt( alive - 1 );
+    for( int round = 1; round < m_tournamentSize; ++ round )
+    {
+      int challenger = 1 + Randomiser::randomInt( alive - 1 );
+      if ( better( m_order[challenger], m_order[winner] ) )
+        winner = challenger;
+    }
+
+    chosen << m_order[winner];
+    std::swap( m_order[winner], m_order[-- alive] );
+  }
+}
+
+void Selection::selectByTruncation( const QVector< float > &keys, QVector< int > &chosen )
+{
+  Better better( keys.constData() );
+  int count = qMin( m_survivors, keys.size() );
+  resetOrder( keys.size() );
+
+  std::nth_element( m_order.begin(), m_order.begin() + count - 1, m_order.end(), better );
+  std::iter_swap( m_order.begin(), std::min_element( m_order.begin(), m_order.begin() + count, better ) );
+  chosen = m_order.mid( 0, count );
+}
+
+void Selection::selectByRank( const QVector< float > &keys, QVector< int > &chosen )
+{
+  int count = keys.size();
+  resetOrder( count );
+  std::sort( m_order.begin(), m_order.end(), Better( keys.constData() ) );
+  chosen << m_order[0];
+
+  int wanted = qMin( m_survivors - 1, count - 1 );
+  if ( wanted <= 0 )
+    return;
+
+  // weighted sampling without replacement (Efraimidis and Spirakis): every candidate draws log(u) / weight
+  // and the highest draws win. the best left has weight count - 1, the worst 1
+  m_draws.resize( count );
+  for( int rank = 1; rank < count; ++ rank )
+  {
+    double u = ( Randomiser::randomInt( 1 << 30 ) + 1.0 ) / ( 1 << 30 );
+    m_draws[rank] = std::log( u ) / ( count - rank );
+  }
+
+  QVector< int > ranks( count - 1 );
+  for( int i = 0; i < ranks.size(); ++ i )
+    ranks[i] = i + 1;
+  const double *draws = m_draws.constData();
+  std::nth_element( ranks.begin(), ranks.begin() + wanted - 1, ranks.end(), [draws]( int a, int b ) { return draws[a] > draws[b]; } );
+
+  for( int i = 0; i < wanted; ++ i )
+    chosen << m_order[ranks[i]];
+}
@@ -0,0 +1,51 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <QVector>
+
+#include "evolutionparameters.h"
+
+/** Picks the scenes that survive each generation. It works on a contiguous array of fitness keys,
+    where lower is always better, and hands back indices into it, so nothing but floats and ints is
+    moved around. Each method only orders as much of the array as it has to: partial sorts and
+    nth_element rather than sorting every candidate, which keeps selection cheap however big the
+    population gets.
+
+    Whatever the method, the best candidate always survives, and comes first */
+
+class Selection
+{
+public:
+  Selection( EvolutionParameters::SelectionMethod method, int survivors, int tournamentSize );
+
+  /// picks the survivors from keys, writing their indices to chosen, the best first. the rest come
+  /// in no particular order
+  void select( const QVector< float > &keys, QVector< int > &chosen );
+
+  /// the worst rank (0 being the best) that can survive out of count candidates. screening uses it
+  /// to tell which children can't possibly make the cut
+  int worstSurvivingRank( int count ) const;
+
+private:
+  /// the best, then each of the others at random from the best tournamentSize of those left
+  void selectFromTop( const QVector< float > &keys, QVector< int > &chosen );
+  /// the best, then each of the others the best of tournamentSize drawn at random
+  void selectByTournament( const QVector< float > &keys, QVector< int > &chosen );
+  /// the best survivors, and nothing else
+  void selectByTruncation( const QVector< float > &keys, QVector< int > &chosen );
+  /// the best, then the others drawn with a weight that falls linearly with rank
+  void selectByRank( const QVector< float > &keys, QVector< int > &chosen );
+
+  /// fills m_order with 0 to count - 1
+  void resetOrder( int count );
+
+  EvolutionParameters::SelectionMethod m_method;
+  int m_survivors;
+  int m_tournamentSize;
+
+  /// indices being ordered, and the draw keys for rank selection. kept so each generation reuses them
+  QVector< int > m_order;
+  QVector< double > m_draws;
+};
+
+#endif // SELECTION_H
@@ -0,0 +1,195 @@
+#include "targetimage.h"
+
+#include <QImageReader>
+#include <QSaveFile>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QPainter>
+
+/// marks the start of a raw copy
+static const quint32 MAGIC = 0x54524754;
+
+struct TargetImage::Mapping
+{
+  Mapping() : data( 0 ) {}
+  ~Mapping()
+  {
+    if ( data )
+      file.unmap( data );
+  }
+
+  QFile file;
+  uchar *data;
+};
+
+TargetImage::TargetImage()
+  : m_data( 0 )
+  , m_format( QImage::Format_RGB32 )
+  , m_width( 0 )
+  , m_height( 0 )
+  , m_bytesPerLine( 0 )
+{
+}
+
+TargetImage::TargetImage( const QImage &image, QImage::Format format )
+  : m_image( image.convertToFormat( format ) )
+  , m_data( 0 )
+  , m_format( format )
+  , m_width( 0 )
+  , m_height( 0 )
+  , m_bytesPerLine( 0 )
+{
+  if ( ! m_image.isNull() )
+  {
+    m_data = m_image.constBits();
+    m_width = m_image.width();
+    m_height = m_image.height();
+    m_bytesPerLine = m_image.bytesPerLine();
+  }
+}
+
+TargetImage TargetImage::load( const QString &path, qint64 budgetBytes )
+{
+  QImageReader reader( path );
+  QSize size( reader.size() );
+  qint64 bytes = qint64( size.width() ) * size.height() * 4;
+  if ( budgetBytes <= 0 || ! size.isValid() || bytes <= budgetBytes / 4 )
+    return TargetImage( QImage( path ) );
+
+  // the copy is named after the file and when it last changed, so an edited image is never matched with a stale copy
+  QFileInfo info( path );
+  QByteArray key( info.absoluteFilePath().toUtf8() );
+  key += '\n' + QByteArray::number( info.size() ) + '\n' + QByteArray::number( info.lastModified().toMSecsSinceEpoch() );
+
+  QDir cacheDir( QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + "/targets" );
+  cacheDir.mkpath( "." );
+  QString cachePath( cacheDir.absoluteFilePath( QCryptographicHash::hash( key, QCryptographicHash::Sha1 ).toHex() + ".rgb32" ) );
+
+  // an earlier run may already have made the copy
+  if ( ! QFile::exists( cachePath ) && ! convert( path, cachePath, budgetBytes ) )
+    return TargetImage();
+
+  return map( cachePath );
+}
+
+QImage TargetImage::rows( int top, int count ) const
+{
+  return QImage( scanLine( top ), m_width, count, m_bytesPerLine, format() );
+}
+
+QImage TargetImage::scaled( const QSize &size ) const
+{
+  if ( ! isMapped() )
+    return size == m_image.size() ? m_image : m_image.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+  QImage result( size, format() );
+  QPainter painter( &result );
+  painter.setRenderHint( QPainter::SmoothPixmapTransform );
+  painter.scale( qreal( size.width() ) / m_width, qreal( size.height() ) / m_height );
+
+  int stripRows = qMax( 1, STRIP_BYTES / m_bytesPerLine );
+  for( int top = 0; top < m_height; top += stripRows )
+    painter.drawImage( QPoint( 0, top ), rows( top, qMin( stripRows, m_height - top ) ) );
+
+  return result;
+}
+
+TargetImage TargetImage::convertedTo( QImage::Format format ) const
+{
+  if ( isMapped() || format == m_format )
+    return *this;
+
+  return TargetImage( m_image, format );
+}
+
+TargetImage TargetImage::copy() const
+{
+  if ( isMapped() || isNull() )
+    return *this;
+
+  return TargetImage( m_image.copy(), m_format );
+}
+
+bool TargetImage::convert( const QString &path, const QString &cachePath, qint64 budgetBytes )
+{
+  QImageReader reader( path );
+  QSize size( reader.size() );
+  if ( ! size.isValid() )
+    return false;
+
+  // written under another name and renamed when it's done, so an interrupted copy is never mapped
+  QSaveFile file( cachePath );
+  if ( ! file.open( QIODevice::WriteOnly ) )
+    return false;
+
+  QByteArray header;
+  QDataStream ds( &header, QIODevice::WriteOnly );
+  ds << MAGIC << qint32( size.width() ) << qint32( size.height() );
+  header.append( QByteArray( HEADER_BYTES - header.size(), 0 ) );
+  file.write( header );
+
+  // formats that can decode part of an image are read in strips that fit the budget. anything else
+  // has to be decoded whole, once, to make the copy
+  qint64 rowBytes = qint64( size.width() ) * 4;
+  int stripRows = size.height();
+  if ( reader.supportsOption( QImageIOHandler::ClipRect ) )
+    stripRows = int( qBound( qint64( 1 ), budgetBytes / 4 / rowBytes, qint64( size.height() ) ) );
+
+  for( int top = 0; top < size.height(); top += stripRows )
+  {
+    int rows = qMin( stripRows, size.height() - top );
+
+    QImageReader stripReader( path );
+    if ( rows < size.height() )
+      stripReader.setClipRect( QRect( 0, top, size.width(), rows ) );
+
+    QImage strip( stripReader.read().convertToFormat( QImage::Format_RGB32 ) );
+    if ( strip.size() != QSize( size.width(), rows ) )
+      return false;
+
+    for( int y = 0; y < rows; ++ y )
+    {
+      if ( file.write( reinterpret_cast< const char* > ( strip.constScanLine( y ) ), rowBytes ) != rowBytes )
+        return false;
+    }
+  }
+
+  return file.commit();
+}
+
+TargetImage TargetImage::map( const QString &cachePath )
+{
+  QSharedPointer< Mapping > mapping( new Mapping );
+  mapping->file.setFileName( cachePath );
+  if ( ! mapping->file.open( QIODevice::ReadOnly ) )
+    return TargetImage();
+
+  quint32 magic = 0;
+  qint32 width = 0;
+  qint32 height = 0;
+  QDataStream ds( &mapping->file );
+  ds >> magic >> width >> height;
+  if ( ds.status() != QDataStream::Ok || magic != MAGIC || width <= 0 || height <= 0 )
+    return TargetImage();
+
+  qint64 bytes = qint64( width ) * height * 4;
+  if ( mapping->file.size() != HEADER_BYTES + bytes )
+    return TargetImage();
+
+  mapping->data = mapping->file.map( HEADER_BYTES, bytes );
+  if ( ! mapping->data )
+    return TargetImage();
+
+  TargetImage target;
+  target.m_mapping = mapping;
+  target.m_data = mapping->data;
+  target.m_width = width;
+  target.m_height = height;
+  target.m_bytesPerLine = width * 4;
+  return target;
+}
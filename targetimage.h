@@ -0,0 +1,73 @@
+#ifndef TARGETIMAGE_H
+#define TARGETIMAGE_H
+
+#include <QImage>
+#include <QSharedPointer>
+
+class QFile;
+
+/** The image being approximated. Small targets are held in memory as a QImage, in whichever format
+    they're being evaluated in (RGB32, or a reduced format such as Grayscale8 or RGB16). Big ones
+    are decoded once, a strip at a time where the file format allows it, to a raw copy in the cache
+    directory that is mapped rather than read, so the operating system pages the target in and out as
+    the fitness function streams through it. A QImage can't be bigger than 2GB, so mapped targets are
+    only ever handed out a strip of rows at a time, and are always RGB32 */
+
+class TargetImage
+{
+public:
+  /// a null target
+  TargetImage();
+  /// a target held in memory, converted to format if it isn't already
+  TargetImage( const QImage &image, QImage::Format format = QImage::Format_RGB32 );
+
+  /// loads the image file at path. anything bigger than a quarter of budgetBytes is mapped, unless
+  /// budgetBytes is 0. returns a null target if the file couldn't be read
+  static TargetImage load( const QString &path, qint64 budgetBytes );
+
+  bool isNull() const { return m_data == 0; }
+  /// true if the target is mapped from disk rather than held in memory
+  bool isMapped() const { return ! m_mapping.isNull(); }
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  QSize size() const { return QSize( m_width, m_height ); }
+  QImage::Format format() const { return m_format; }
+  int bytesPerLine() const { return m_bytesPerLine; }
+
+  const uchar *scanLine( int y ) const { return m_data + qint64( y ) * m_bytesPerLine; }
+
+  /// a read-only image of count rows from top down, sharing the target's memory. it's only valid for
+  /// as long as the target is
+  QImage rows( int top, int count ) const;
+  /// a copy scaled to size, made a strip at a time for mapped targets
+  QImage scaled( const QSize &size ) const;
+  /// the same target in another format. mapped targets can't be converted, and are returned as they are
+  TargetImage convertedTo( QImage::Format format ) const;
+  /// a copy of the pixels, allocated and written by the calling thread so they land on its NUMA node.
+  /// mapped targets share the operating system's cache of the file, and are returned as they are
+  TargetImage copy() const;
+
+private:
+  /// writes the raw copy of the image at path to cachePath, decoding no more than budgetBytes of it at a time
+  static bool convert( const QString &path, const QString &cachePath, qint64 budgetBytes );
+  /// maps a raw copy written by convert()
+  static TargetImage map( const QString &cachePath );
+
+  struct Mapping;
+
+  QImage m_image;
+  QSharedPointer< Mapping > m_mapping;
+  const uchar *m_data;
+  QImage::Format m_format;
+  int m_width;
+  int m_height;
+  int m_bytesPerLine;
+
+  /// the raw copy starts with a header this long, so the pixels start on a cache line
+  static const int HEADER_BYTES = 64;
+  /// how much of a mapped target is scaled at once
+  static const int STRIP_BYTES = 16 * 1024 * 1024;
+};
+
+#endif // TARGETIMAGE_H
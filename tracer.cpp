@@ -0,0 +1,130 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include <QAtomicInteger>
+
+struct Tracer::Event
+{
+  const char *name;
+  qint64 start;
+  qint64 end;
+};
+
+struct Tracer::Buffer
+{
+  Buffer() : events( EVENTS_PER_THREAD ), thread( 0 ) {}
+
+  QVector< Event > events;
+  /// events written so far. only the owning thread writes, so it's only atomic for write() to read
+  QAtomicInteger< quint64 > written;
+  int thread;
+  QString threadName;
+};
+
+Tracer Tracer::s_tracer;
+Tracer *Tracer::s_instance = &Tracer::s_tracer;
+
+Tracer::Tracer()
+  : m_startedAt( 0 )
+{
+  m_clock.start();
+}
+
+Tracer::~Tracer()
+{
+}
+
+void Tracer::start()
+{
+  m_startedAt = now();
+  m_enabled.storeRelease( 1 );
+}
+
+void Tracer::stop()
+{
+  m_enabled.storeRelease( 0 );
+}
+
+void Tracer::record( const char *name, qint64 start, qint64 end )
+{
+  Buffer *buffer = localBuffer();
+  quint64 written = buffer->written.load();
+
+  Event &event = buffer->events.data()[written % EVENTS_PER_THREAD];
+  event.name = name;
+  event.start = start;
+  event.end = end;
+
+  buffer->written.storeRelease( written + 1 );
+}
+
+Tracer::Buffer *Tracer::localBuffer()
+{
+  if ( ! m_localBuffers.hasLocalData() )
+  {
+    QSharedPointer< Buffer > buffer( new Buffer );
+    QThread *thread = QThread::currentThread();
+    if ( QCoreApplication::instance() && thread == QCoreApplication::instance()->thread() )
+      buffer->threadName = "main";
+    else
+      buffer->threadName = thread->objectName().isEmpty() ? QString( "thread" ) : thread->objectName();
+
+    QMutexLocker locker( &m_mutex );
+    buffer->thread = m_buffers.count() + 1;
+    m_buffers << buffer;
+    m_localBuffers.setLocalData( buffer );
+  }
+
+  return m_localBuffers.localData().data();
+}
+
+bool Tracer::write( const QString &path ) const
+{
+  QFile file( path );
+  if ( ! file.open( QFile::WriteOnly | QFile::Truncate | QFile::Text ) )
+    return false;
+
+  QTextStream ts( &file );
+  ts << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  qint64 pid = QCoreApplication::applicationPid();
+  bool first = true;
+
+  QMutexLocker locker( &m_mutex );
+  foreach( const QSharedPointer< Buffer > &buffer, m_buffers )
+  {
+    ts << ( first ? "\n" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->thread
+       << ",\"args\":{\"name\":\"" << buffer->threadName << " " << buffer->thread << "\"}}";
+    first = false;
+
+    // copy what's there, then throw away anything the thread may have written over while it was copied
+    quint64 end = buffer->written.loadAcquire();
+    quint64 begin = end > quint64( EVENTS_PER_THREAD ) ? end - EVENTS_PER_THREAD : 0;
+    QVector< Event > events;
+    events.reserve( int( end - begin ) );
+    for( quint64 i = begin; i < end; ++ i )
+      events << buffer->events.at( int( i % EVENTS_PER_THREAD ) );
+
+    quint64 after = buffer->written.loadAcquire();
+    quint64 intact = after >= quint64( EVENTS_PER_THREAD ) ? after - EVENTS_PER_THREAD + 1 : 0;
+
+    for( int i = 0; i < events.count(); ++ i )
+    {
+      const Event &event = events.at( i );
+      if ( begin + i < intact || event.start < m_startedAt )
+        continue;
+
+      ts << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->thread
+         << ",\"ts\":" << QString::number( event.start / 1000.0, 'f', 3 )
+         << ",\"dur\":" << QString::number( ( event.end - event.start ) / 1000.0, 'f', 3 ) << "}";
+    }
+  }
+
+  ts << "\n]}\n";
+  ts.flush();
+  return file.error() == QFile::NoError;
+}
@@ -0,0 +1,101 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QMutex>
+#include <QList>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QThreadStorage>
+#include <QSharedPointer>
+
+/** Records when tasks start and finish on every thread, for viewing as a timeline in Chrome's
+    about:tracing or Perfetto. Off unless started, when each event costs a check of one flag.
+
+    Each thread writes into a ring buffer of its own, so recording takes no locks (only a thread's
+    first event does, to register its buffer). The buffers keep the most recent EVENTS_PER_THREAD
+    events, so tracing can be left on and only the last stretch before write() is kept.
+
+    Plugins are built with their own copy of this class, so the host hands them its tracer with
+    setInstance(), and their events go into the same timeline */
+
+class Tracer
+{
+public:
+  ~Tracer();
+
+  /// the tracer events are recorded with
+  static Tracer &instance() { return *s_instance; }
+  /// records events with another tracer, such as a plugin's host's
+  static void setInstance( Tracer *tracer ) { s_instance = tracer; }
+
+  /// starts recording. anything recorded before this is left out of the next write()
+  void start();
+  void stop();
+  bool isEnabled() const { return m_enabled.load() != 0; }
+
+  /// writes what the buffers hold, as Chrome trace event json. can be called while threads are still recording
+  bool write( const QString &path ) const;
+
+  /// nanoseconds on the tracer's clock
+  qint64 now() const { return m_clock.nsecsElapsed(); }
+  /// records a task from start to end on the calling thread. name isn't copied, so it must be a string literal
+  void record( const char *name, qint64 start, qint64 end );
+
+  /// the most events each thread's buffer holds
+  static const int EVENTS_PER_THREAD = 32768;
+
+private:
+  Tracer();
+  Q_DISABLE_COPY( Tracer )
+
+  struct Event;
+  struct Buffer;
+
+  /// the calling thread's buffer, created the first time it's needed
+  Buffer *localBuffer();
+
+  static Tracer s_tracer;
+  static Tracer *s_instance;
+
+  QAtomicInt m_enabled;
+  QElapsedTimer m_clock;
+  /// when recording last started. events before it aren't written
+  qint64 m_startedAt;
+
+  QThreadStorage< QSharedPointer< Buffer > > m_localBuffers;
+  /// guards m_buffers, which holds every thread's buffer so they can be written after their threads finish
+  mutable QMutex m_mutex;
+  QList< QSharedPointer< Buffer > > m_buffers;
+};
+
+/** Records the time from construction to destruction (or end()) as a task, if tracing is on */
+
+class TraceScope
+{
+public:
+  /// name must be a string literal
+  explicit TraceScope( const char *name )
+    : m_name( name )
+    , m_start( Tracer::instance().isEnabled() ? Tracer::instance().now() : -1 )
+  {
+  }
+
+  ~TraceScope() { end(); }
+
+  /// ends the task early, such as when only a lock's wait is of interest and not what it guards
+  void end()
+  {
+    if ( m_start >= 0 )
+      Tracer::instance().record( m_name, m_start, Tracer::instance().now() );
+    m_start = -1;
+  }
+
+private:
+  Q_DISABLE_COPY( TraceScope )
+
+  const char *m_name;
+  qint64 m_start;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Microbenchmarks for the engine's hot paths. Uses synthetic targets
+# and fixed seeds, so it needs no images, and prints JSON (or CSV with
+# --csv) for comparing one build with another:
+#
+#   qmake triangles-bench.pro -o Makefile.bench && make -f Makefile.bench
+#   ./triangles-bench > bench.json
+#   ./triangles-bench --convergence > convergence.json
+#
+#-------------------------------------------------
+
+include(engine.pri)
+
+TARGET = triangles-bench
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+
+# keep the objects apart from the other builds, which share the same directory
+OBJECTS_DIR = .obj-bench
+MOC_DIR = .moc-bench
+
+SOURCES += benchmain.cpp \
+    benchtargets.cpp \
+    convergencebench.cpp
+
+HEADERS += benchtargets.h \
+    convergencebench.h
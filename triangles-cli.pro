@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Headless driver for the evolution engine. Doesn't link QtWidgets
+# or need a display, so it can run on render nodes:
+#
+#   qmake triangles-cli.pro -o Makefile.cli && make -f Makefile.cli
+#
+#-------------------------------------------------
+
+include(engine.pri)
+
+QT += network
+
+TARGET = triangles-cli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+# keep the objects apart from the gui build, which shares the same directory
+OBJECTS_DIR = .obj-cli
+MOC_DIR = .moc-cli
+
+SOURCES += climain.cpp \
+    evolutiondaemon.cpp
+
+HEADERS += evolutiondaemon.h
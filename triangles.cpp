@@ -9,11 +9,11 @@
 #include <QFuture>
 #include <QMessageBox>
 #include <QGraphicsPixmapItem>
+#include <QFileInfo>
 
-#include "trianglescene.h"
-#include "emberscene.h"
-#include "faceweightedpixelsumfitness.h"
-#include "randomiser.h"
+#include "pluginregistry.h"
+#include "tracer.h"
+#include "numatopology.h"
 
 Triangles::Triangles(QWidget *parent, Qt::WindowFlags flags)
     : QDialog(parent, flags)
@@ -26,11 +26,9 @@ Triangles::Triangles(QWidget *parent, Qt::WindowFlags flags)
 
   ui.inputFrameGroup->setCurrentIndex( 0 );
 
-  m_running = false;
+  m_engine = 0;
   clear();
 
-  m_oclWrapper.CheckOpenCL();
-
   connect( ui.reset, SIGNAL( clicked() ), this, SLOT( clear() ) );
   connect( ui.start, SIGNAL( clicked() ), this, SLOT( run() ) );
   connect( ui.stop, SIGNAL( clicked() ), this, SLOT( stop() ) );
@@ -40,419 +38,132 @@ Triangles::Triangles(QWidget *parent, Qt::WindowFlags flags)
   connect( ui.usePsfw, SIGNAL( toggled(bool) ), this, SLOT( setFitnessFrame() ) );
   connect( ui.usePs, SIGNAL( toggled(bool) ), this, SLOT( setFitnessFrame() ) );
   connect( ui.useSsim, SIGNAL( toggled(bool) ), this, SLOT( setFitnessFrame() ) );
-
-  foreach( std::string platform, m_oclWrapper.PlatformNames() )
-    ui.openclPlatform->addItem( QString::fromStdString( platform ) );
-
-  populateDeviceList();
-
-  QThreadPool::globalInstance()->setMaxThreadCount( 32 );
+  connect( &m_refreshTimer, SIGNAL( timeout() ), this, SLOT( refreshView() ) );
+  connect( &m_evolution, SIGNAL( finished() ), this, SLOT( evolutionFinished() ) );
+
+  // flames come from a plugin, which might not be installed
+  m_platformsListed = false;
+  ui.useFlames->setEnabled( PluginRegistry::instance().sceneType( "flames" ) != 0 );
+
+  // TRIANGLES_THREADS sets the worker count, and TRIANGLES_PIN_THREADS=1 pins them across the NUMA nodes
+  int threads = qgetenv( "TRIANGLES_THREADS" ).toInt();
+  QThreadPool::globalInstance()->setMaxThreadCount( threads > 0 ? threads : 32 );
+  if ( qgetenv( "TRIANGLES_PIN_THREADS" ) == "1" && ! NumaTopology::pinPool( QThreadPool::globalInstance() ) )
+    qWarning( "Worker threads can't be pinned on this platform" );
+
+  QString metricsAddress( qgetenv( "TRIANGLES_METRICS" ) );
+  m_servingMetrics = ! metricsAddress.isEmpty() && m_metrics.listen( metricsAddress );
+  if ( ! metricsAddress.isEmpty() && ! m_servingMetrics )
+    qWarning( "Couldn't serve metrics on %s: %s", qPrintable( metricsAddress ), qPrintable( m_metrics.errorString() ) );
 }
 
 Triangles::~Triangles()
 {
-
-}
-
-void Triangles::calculateFitnessForScene( const AbstractFitness *fitness, AbstractScene *scene )
-{
-  QImage candidateImage( fitness->target() );
-  while ( ! scene->renderTo( candidateImage ) )
-    scene->randomise();
-
-  scene->setFitness( fitness->getFitness( candidateImage ) );
+  stop();
+  m_evolution.waitForFinished();
+  delete m_engine;
 }
 
 void Triangles::run()
 {
-  enum scenetype { TRIANGLES, EMBERS };
-
-  scenetype scenetype = TRIANGLES;
-  if ( ui.useFlames->isChecked() )
-    scenetype = EMBERS;
-
-  if ( scenetype == EMBERS )
+  if ( m_engine || m_target.isNull() )
+    return;
+
+  EvolutionParameters params;
+  params.sceneType = ui.useFlames->isChecked() ? "flames" : "triangles";
+  params.triangleCount = ui.triangleCount->value();
+  params.populationSize = ui.poolSize->value();
+  params.tournamentSize = ui.tournamentSize->value();
+  params.mutationStrength = ui.mutationStrength->value();
+  params.generationCount = ui.generationCount->value();
+  params.maxAge = ui.maxAge->value();
+  params.faceWeight = ui.faceWeight->value();
+  params.updatesPerSec = ui.updateFrequency->value();
+  params.palettesFile = ui.palettesFile->text();
+  params.flameBackend = ui.flameBackend->currentIndex() == 1 ? EvolutionParameters::CpuBackend : EvolutionParameters::OpenCLBackend;
+  params.openclPlatform = ui.openclPlatform->currentIndex();
+  params.openclDevice = ui.openclDevice->currentIndex();
+  params.maxXforms = ui.maxXforms->value();
+
+  m_engine = new EvolutionEngine( m_target, m_imageFilename + ".triangles", params );
+  if ( m_servingMetrics )
+    m_engine->setMetrics( &m_metrics, QFileInfo( m_imageFilename ).fileName() );
+  if ( ! m_engine->initialise() )
   {
-    if ( ! EmberScene::initialiseRenderer( ui.palettesFile->text(), ui.openclPlatform->currentIndex(), ui.openclDevice->currentIndex() ) )
-    {
-      QMessageBox::critical( this, "Derp!", "Couldn't initialise opencl renderer" );
-      return;
-    }
+    QMessageBox::critical( this, "Derp!", m_engine->errorString() );
+    delete m_engine;
+    m_engine = 0;
+    return;
   }
 
-  // initialise the candates to m_target, to match format and size
-  m_bestCandidate = m_target;
-  m_currentCandidate = m_target;
-
-  // initialise everything
-  int populationSize = ui.poolSize->value();
-
-  m_currentFitness = -1;
-  m_bestFitness = -1;
-
-  float iterationsPerSec = 0;
-
-  QList< AbstractScene* > previousAge;
-  QList< AbstractScene* > nextAge;
-
-  QDir logDir( m_imageFilename + ".triangles" );
-  removeDir( m_imageFilename + ".triangles" );
-  logDir.mkdir( m_imageFilename + ".triangles" );
-
-  QFile bestScenesFile( logDir.absoluteFilePath( "bestScenes.log" ) );
-  bestScenesFile.open( QFile::WriteOnly | QFile::Truncate );
-  QDataStream bestScenes( &bestScenesFile );
-
-  int faceWeight = ui.faceWeight->value();
-  m_running = true;
-
-  AbstractFitness *fitness = new FaceWeightedPixelSumFitness( m_target, faceWeight);
-
-  int age = 0;
-  int culture = 0;
-  int maxCultures = 0;
-
-  updateDialog( 0, 0, 0, 0, 0, 0, 0, 0 );
-
-  AbstractScene *bestScene = 0;
-
-  if ( scenetype == TRIANGLES )
-    bestScene = new TriangleScene( 0, 0, 0, QColor() );
-  if ( scenetype == EMBERS )
-    bestScene = new EmberScene( 300, 300 );
+  ui.start->setEnabled( false );
 
-  int iterations = 0;
-  int maxIterations = 0;
-  quint64 acceptCount = 0;
-  int improvements = 0;
-
-  logDir.remove( logDir.absoluteFilePath( "age." + QString::number( age ) + ".log" ) );
-
-  // loop until the user tells us to stop
-  while( m_running )
-  {
-    // each age simulates a number of cultures over a set number of iterations.
-    // at the start of every new age, the best cultures from the previous age are selected and merged into a smaller number
-    // of cultures by placing the best scene from each into a new scene pool
-
-    // one culture simulates one attempt to find the best fitness from a given starting point over a certain number of iterations
-    // each culture has a scene pool of a certaion size. for each iteration, the scene pool is mutated and scenes are cross-bred
-    // with each other. the scenes with the best fitness survive to the next iteration.
-
-    // this loop runs once per culture. age-management variables persist across runs
-
-    // start by setting up the logs...
-    QFile cultureLogFile( logDir.absoluteFilePath( "culture." + QString::number( age ) + "." + QString::number( culture ) + ".log" ) );
-    cultureLogFile.open( QFile::WriteOnly | QFile::Truncate );
-    QDataStream cultureLog( &cultureLogFile );
-
-    QFile ageLogFile( logDir.absoluteFilePath( "age." + QString::number( age ) + ".log" ) );
-    ageLogFile.open( QFile::WriteOnly | QFile::Append );
-    QDataStream ageLog( &ageLogFile );
-
-    // our pool of scenes for the current culture
-    QList< AbstractScene* > pool;
-
-    // the maximum number of cultures for the given age
-    maxCultures = 0;
-    // run many more iterations for future ages, as we hit diminishing returns
-    maxIterations = ( ui.generationCount->value() * ( 1 << age ) );
-
-    // run more cultures in earlier ages, so we can throw away the items with the lowest fitness more swiftly
-    for( int i = 0; i < ui.maxAge->value() - age; ++ i )
-    {
-      if ( maxCultures == 0 )
-        maxCultures = populationSize;
-      else
-        maxCultures *= 4;
-    }
-    if ( age == ui.maxAge->value() )
-      maxIterations = 0;
-
-    // set up the current pool
-    m_currentFitness = -1;
-    if ( previousAge.isEmpty() )
-    {
-      // if there's no previous age, we're in the first age so initialise the pool with random values
-      for( int i = 0; i < populationSize; ++ i )
-      {
-        if ( scenetype == TRIANGLES )
-          pool.append( new TriangleScene( ui.triangleCount->value(), m_target.width(), m_target.height(), QColor( 255, 255, 255, 255 ) ) );
-        if ( scenetype == EMBERS )
-          pool.append( new EmberScene( m_target.width(), m_target.height() ) );
-
-        calculateFitnessForScene( fitness, pool[i] );
-      }
-    } else {
-      // randomly take scenes from theprevious age to populate this one
-      for( int i = 0; i < populationSize; ++ i )
-      {
-        pool.append( previousAge[ Randomiser::randomInt( previousAge.count() ) ]->clone() );
-      }
-    }
-
-    // calculate the current and best fitness for this age, based on the new culture
-    for( int i = 0; i < populationSize; ++ i )
-    {
-      if ( fitness->isBetterFitness( pool[i]->fitness(), m_currentFitness ) || m_currentFitness < 0 )
-      {
-        m_currentFitness = pool[i]->fitness();
-
-        pool[i]->renderTo( m_currentCandidate );
-      }
-      if ( fitness->isBetterFitness( pool[i]->fitness(), m_bestFitness ) || m_bestFitness < 0 )
-      {
-        m_bestFitness = pool[i]->fitness();
-
-        pool[i]->renderTo( m_bestCandidate );
-      }
-    }
-
-    // update the dialog with our starting variables
-    updateDialog( iterations, acceptCount, improvements, age, culture, maxCultures, maxIterations, iterationsPerSec );
-
-    iterations = 0;
-    acceptCount = 0;
-    improvements = 0;
-
-    QElapsedTimer timer;
-    timer.start();
-
-    // run the loop for the current culture (or indefinitely for the last culture)
-    while ( ( maxIterations == 0 || iterations < maxIterations ) && m_running )
-    {
-      // set up containers for the current generation, and the next
-      QSet< AbstractScene * > gen1( pool.toSet() );
-      QList< AbstractScene * > gen2;
-
-      QList< QFuture< void > > futures;
-
-      // take scenes at random from the pool, in pairs...
-      while( pool.count() )
-      {
-        AbstractScene *p1 = pool.takeAt( Randomiser::randomInt( pool.count() ) );
-        AbstractScene *p2 = pool.takeAt( Randomiser::randomInt( pool.count() ) );
-        // cross-breed and mutate the pair
-        QPair< AbstractScene*, AbstractScene* > children = p1->breed( p2, ui.mutationStrength->value() );
-
-        // run the fitness function for the newly-generated children using the thread pool
-        futures << QtConcurrent::run( calculateFitnessForScene, fitness, children.first );
-        futures << QtConcurrent::run( calculateFitnessForScene, fitness, children.second );
-
-        // add both parents and both clildren to the next generation's pool
-        gen2 << p1;
-        gen2 << p2;
-        gen2 << children.first;
-        gen2 << children.second;
-      }
-
-      // wait for the fitness functions from this generation to complete
-      while( futures.count() )
-      {
-        while( futures.last().isRunning() )
-          futures.last().waitForFinished();
-        futures.takeLast();
-      }
-
-      // sort the next generation by fitness
-      qSort( gen2.begin(), gen2.end(), fitness->sceneHasBetterFitnessMethod() );
-
-      // if the next generation has a better fitness than the current best fitness, update the candidate data
-      if ( fitness->isBetterFitness( gen2.first()->fitness(), m_currentFitness ) )
-      {
-        ++ improvements;
-        m_currentFitness = gen2.first()->fitness();
-        if ( scenetype != EMBERS )
-          gen2.first()->saveToStream( cultureLog );
-
-        gen2.first()->renderTo( m_currentCandidate );
-
-        if ( fitness->isBetterFitness( m_currentFitness, m_bestFitness ) )
-        {
-          m_bestFitness = m_currentFitness;
-          delete bestScene;
-          bestScene = gen2.first()->clone();
-          bestScenes << iterations;
-          bestScenes << m_currentFitness;
-          if ( scenetype != EMBERS )
-            bestScene->saveToStream( bestScenes );
-
-          m_bestCandidate = m_currentCandidate;
-        }
-      }
-
-      // populate the next pool
-      for( int i = 0; i < populationSize; ++ i )
-      {
-        if ( i == 0 )
-        {
-          // always include the best candidate
-          pool.append( gen2.takeFirst() );
-        } else {
-          // take other candidates at random from the best n results (where n is the tournament size) to keep the gene pool more varied
-          int selection = Randomiser::randomInt( ui.tournamentSize->value() );
-          AbstractScene *s = gen2.takeAt( selection );
-          if ( ! gen1.contains( s ) )
-          {
-            ++ acceptCount;
-          }
-          pool.append( s );
-        }
-      }
-
-      // clear the next pool and sort the current data, ready for another iteration
-      qDeleteAll( gen2 );
-      qSort( pool.begin(), pool.end(), fitness->sceneHasBetterFitnessMethod() );
-
-      ++ iterations;
-
-      iterationsPerSec = static_cast< float > ( iterations ) / static_cast< float > ( timer.elapsed() / 1000 );
-
-      // update the window if we've covered enough iterations
-      if ( iterations % ui.updateFrequency->value() == 0 )
-      {
-        updateDialog( iterations, acceptCount, improvements, age, culture, maxCultures, maxIterations, iterationsPerSec );
-      }
-    }
-
-    // we've completed all the iterations for the culture...
-
-    // write the best candidate to the age log, and place into the next age
-    if ( scenetype != EMBERS )
-      pool.first()->saveToStream( ageLog );
-    nextAge.append( pool.takeFirst() );
-
-    // clear the pool and advance to the next culture
-    qDeleteAll( pool );
-    ++ culture;
-
-    // if we've been through all the cultures, advance to the next age
-    if ( culture == maxCultures )
-    {
-      qDeleteAll( previousAge );
-      previousAge = nextAge;
-      nextAge.clear();
-      culture = 0;
-      ++ age;
-      logDir.remove( logDir.absoluteFilePath( "age." + QString::number( age ) + ".log" ) );
-    }
-
-    updateDialog( iterations, acceptCount, improvements, age, culture, maxCultures, maxIterations, iterationsPerSec );
-  }
-
-  // the user has told us to stop...
-
-  // update the screen
-  updateDialog( iterations, acceptCount, improvements, age, culture, maxCultures, maxIterations, iterationsPerSec );
-
-  // delete everyhing that's left
-  qDeleteAll( nextAge );
-  qDeleteAll( previousAge );
-
-  // save the best scene to an svg
-  bestScene->saveToFile( logDir.absoluteFilePath( "bestPicture.svg" ) );
-
-  // iterate over the best scenes file, so that we can see the history of all improvements
-  bestScenesFile.close();
-  bestScenesFile.open( QFile::ReadOnly );
-  QDataStream bestScenesLoader( &bestScenesFile );
-  logDir.mkdir( "bestScenes" );
-  QDir bsDir( logDir.absoluteFilePath( "bestScenes" ) );
-  int count = 0;
-  while( ! bestScenesLoader.atEnd() )
-  {
-    int iteration;
-    float fitness;
-    bestScenesLoader >> iteration;
-    bestScenesLoader >> fitness;
-    QString bsFilePath = bsDir.absoluteFilePath( QString( "%1.%2.svg" ).arg( count, 7, 10, QLatin1Char( '0' ) ).arg( iteration ) );
-
-    AbstractScene *s = 0;
-
-    if ( scenetype == TRIANGLES )
-      s = new TriangleScene( ui.triangleCount->value(), m_target.width(), m_target.height(), QColor( 255, 255, 255, 255 ) );
-
-    if ( scenetype == EMBERS )
-      s = new EmberScene( m_target.width(), m_target.height() );
-
-    if ( scenetype != EMBERS )
-    {
-      s->loadFromStream( bestScenesLoader );
-      s->saveToFile( bsFilePath );
-    }
-
-    delete s;
-
-    ++ count;
-  }
-
-  delete bestScene;
-
-  // write out the best svgs for each individual culture
-  QStringList filters;
-  filters.append( "age.*.log" );
-  //filters.append( "culture.*.log" );
-  foreach( QString logEntry, logDir.entryList( filters ) )
-  {
-    logDir.mkdir( logEntry + ".d" );
-    QDir entryDir( logDir.absoluteFilePath( logEntry + ".d" ) );
-    QFile lf( logDir.absoluteFilePath( logEntry ) );
-    lf.open( QFile::ReadOnly );
-    QDataStream d( &lf );
-    count = 0;
-    while( !d.atEnd() )
-    {
-      QString fp = entryDir.absoluteFilePath( QString( "%1.svg" ).arg( count, 7, 10, QLatin1Char( '0' ) ) );
-      AbstractScene *s = 0;
-
-      if ( scenetype == TRIANGLES )
-        s = new TriangleScene( ui.triangleCount->value(), m_target.width(), m_target.height(), QColor( 255, 255, 255, 255 ) );
-
-      if ( scenetype == EMBERS )
-        s = new EmberScene( m_target.width(), m_target.height() );
-
-      s->loadFromStream( d );
-      s->saveToFile( fp );
-      delete s;
-
-      ++ count;
-    }
-  }
+  m_refreshTimer.start( qMax( 1, 1000 / params.updatesPerSec ) );
+  m_evolution.setFuture( QtConcurrent::run( m_engine, &EvolutionEngine::run ) );
+}
 
-  if ( scenetype == EMBERS )
-    EmberScene::destroyRenderer();
+void Triangles::refreshView()
+{
+  if ( ! m_engine )
+    return;
+
+  TraceScope trace( "refresh" );
+
+  EvolutionSnapshot *snapshot = m_engine->snapshots().take();
+  if ( ! snapshot )
+    return;
+
+  ui.iteration->setText( QString::number( snapshot->iterations ) + "/" + QString::number( snapshot->maxIterations ) );
+  ui.acceptCount->setText( QString::number( snapshot->acceptCount ) );
+  ui.improvements->setText( QString::number( snapshot->improvements ) );
+  ui.age->setText( QString::number( snapshot->age ) );
+  ui.culture->setText( QString::number( snapshot->culture ) + "/" + QString::number( snapshot->maxCultures ) );
+  ui.bestFitness->setText( QString::number( snapshot->bestFitness ) );
+  ui.currentFitness->setText( QString::number( snapshot->currentFitness ) );
+  ui.iterationsPerSec->setText( QString::number( snapshot->iterationsPerSec ) );
+  ui.evaluationsPerSec->setText( QString::number( snapshot->evaluationsPerSec ) );
+  ui.allocationsPerIteration->setText( snapshot->totalGenerations ? QString::number( static_cast< double > ( snapshot->phases.allocations ) / snapshot->totalGenerations, 'f', 1 ) : "0" );
+  ui.phaseTimes->setText( snapshot->phases.summary() );
+  ui.cacheHitRate->setText( QString( "%1%" ).arg( snapshot->phases.cacheHitRate() * 100.0, 0, 'f', 1 ) );
+  updateCandidateView( *snapshot );
+
+  delete snapshot;
 }
 
-void Triangles::updateDialog( int iterations, quint64 acceptCount, int improvements, int age, int culture, int maxCultures, int maxIterations, float iterationsPerSec )
+void Triangles::evolutionFinished()
 {
-  ui.iteration->setText( QString::number( iterations ) + "/" + QString::number( maxIterations ) );
-  ui.acceptCount->setText( QString::number( acceptCount ) );
-  ui.improvements->setText( QString::number( improvements ) );
-  ui.age->setText( QString::number( age ) );
-  ui.culture->setText( QString::number( culture ) + "/" + QString::number( maxCultures ) );
-  ui.bestFitness->setText( QString::number( m_bestFitness ) );
-  ui.currentFitness->setText( QString::number( m_currentFitness ) );
-  ui.iterationsPerSec->setText( QString::number( iterationsPerSec) );
-  updateCandidateView();
-  qApp->processEvents();
+  m_refreshTimer.stop();
+  // pick up whatever was published after the last tick
+  refreshView();
+  ui.start->setEnabled( true );
+
+  delete m_engine;
+  m_engine = 0;
 }
 
 void Triangles::stop()
 {
-  m_running = false;
+  if ( m_engine )
+    m_engine->stop();
 }
 
 void Triangles::clear()
 {
+  if ( m_engine )
+    return;
+
+  EvolutionParameters defaults;
+
   ui.iteration->setText( "0" );
-  ui.triangleCount->setValue( 20 );
-  ui.poolSize->setValue( 10 );
-  ui.tournamentSize->setValue( 2 );
-  ui.mutationStrength->setValue( 0 );
-  ui.generationCount->setValue( 10000 );
-  ui.faceWeight->setValue( 10 );
-  ui.maxAge->setValue( 1 );
-  ui.updateFrequency->setValue( 1 );
+  ui.triangleCount->setValue( defaults.triangleCount );
+  ui.poolSize->setValue( defaults.populationSize );
+  ui.tournamentSize->setValue( defaults.tournamentSize );
+  ui.mutationStrength->setValue( defaults.mutationStrength );
+  ui.generationCount->setValue( defaults.generationCount );
+  ui.faceWeight->setValue( defaults.faceWeight );
+  ui.maxAge->setValue( defaults.maxAge );
+  ui.updateFrequency->setValue( defaults.updatesPerSec );
+  ui.maxXforms->setValue( defaults.maxXforms );
   ui.age->setText( "0" );
   ui.culture->setText( "0" );
   ui.currentFitness->setText( "0" );
@@ -460,11 +171,7 @@ void Triangles::clear()
   ui.acceptCount->setText( "0" );
   ui.improvements->setText( "0" );
 
-  m_bestCandidate = QImage();
-  m_currentCandidate = QImage();
   m_target = QImage();
-  m_currentFitness = 0;
-  m_bestFitness = 0;
 
   ui.target->scene()->clear();
   ui.bestCandidate->scene()->clear();
@@ -473,6 +180,9 @@ void Triangles::clear()
 
 void Triangles::selectTarget()
 {
+  if ( m_engine )
+    return;
+
   QString imageFile( QFileDialog::getOpenFileName( this, "Select Image" ) );
   if ( imageFile.length() )
   {
@@ -507,64 +217,48 @@ void Triangles::resizeEvent( QResizeEvent *e )
     ui.bestCandidate->fitInView( items.first(), Qt::KeepAspectRatio );
 }
 
-void Triangles::updateCandidateView()
+void Triangles::updateCandidateView( const EvolutionSnapshot &snapshot )
 {
   QGraphicsPixmapItem *item = 0;
   if ( ui.bestCandidate->scene()->items().count() == 0 )
-    item = ui.bestCandidate->scene()->addPixmap( QPixmap::fromImage( m_bestCandidate ) );
+    item = ui.bestCandidate->scene()->addPixmap( QPixmap::fromImage( snapshot.bestCandidate ) );
   else
   {
     item = dynamic_cast< QGraphicsPixmapItem * > ( ui.bestCandidate->scene()->items().first() );
     if ( item )
     {
-      item->setPixmap( QPixmap::fromImage( m_bestCandidate ) );
+      item->setPixmap( QPixmap::fromImage( snapshot.bestCandidate ) );
     }
   }
   ui.bestCandidate->fitInView( item, Qt::KeepAspectRatio );
 
   if ( ui.currentCandidate->scene()->items().count() == 0 )
-    item = ui.currentCandidate->scene()->addPixmap( QPixmap::fromImage( m_currentCandidate ) );
+    item = ui.currentCandidate->scene()->addPixmap( QPixmap::fromImage( snapshot.currentCandidate ) );
   else
   {
     item = dynamic_cast< QGraphicsPixmapItem * > ( ui.currentCandidate->scene()->items().first() );
     if ( item )
     {
-      item->setPixmap( QPixmap::fromImage( m_currentCandidate ) );
+      item->setPixmap( QPixmap::fromImage( snapshot.currentCandidate ) );
     }
   }
   ui.currentCandidate->fitInView( item, Qt::KeepAspectRatio );
 }
 
-bool Triangles::removeDir(const QString &dirName)
-{
-  bool result = true;
-  QDir dir(dirName);
-
-  if (dir.exists(dirName)) {
-    Q_FOREACH(QFileInfo info, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::System | QDir::Hidden  | QDir::AllDirs | QDir::Files, QDir::DirsFirst)) {
-      if (info.isDir()) {
-        result = removeDir(info.absoluteFilePath());
-      }
-      else {
-        result = QFile::remove(info.absoluteFilePath());
-      }
-
-      if (!result) {
-        return result;
-      }
-    }
-    result = dir.rmdir(dirName);
-  }
-
-  return result;
-}
-
 void Triangles::setMethodFrame()
 {
   if (ui.useTriangles->isChecked())
     ui.inputFrameGroup->setCurrentIndex(0);
   else
     ui.inputFrameGroup->setCurrentIndex(1);
+
+  SceneType *flames = PluginRegistry::instance().sceneType( "flames" );
+  if ( ui.useFlames->isChecked() && flames && ! m_platformsListed )
+  {
+    ui.openclPlatform->addItems( flames->platforms() );
+    populateDeviceList();
+    m_platformsListed = true;
+  }
 }
 
 void Triangles::setFitnessFrame()
@@ -581,6 +275,7 @@ void Triangles::populateDeviceList()
 {
   ui.openclDevice->clear();
 
-  foreach( std::string device, m_oclWrapper.DeviceNames( ui.openclPlatform->currentIndex() ) )
-    ui.openclDevice->addItem( QString::fromStdString( device ) );
+  SceneType *flames = PluginRegistry::instance().sceneType( "flames" );
+  if ( flames )
+    ui.openclDevice->addItems( flames->devices( ui.openclPlatform->currentIndex() ) );
 }
@@ -5,13 +5,13 @@
 #include "ui_triangles.h"
 
 #include <QImage>
+#include <QTimer>
+#include <QFutureWatcher>
 
-#include "abstractscene.h"
-#include "abstractfitness.h"
+#include "evolutionengine.h"
+#include "metricsserver.h"
 #include <qmath.h>
 
-#include <OpenCLWrapper.h>
-
 /** Main dialog that runs all of the top-level logic and displays progres */
 
 class Triangles : public QDialog
@@ -43,37 +43,39 @@ private slots:
   /// sets the correct input frame on radio button selection
   void setFitnessFrame();
 
-  /// populates the opencl device list when the platform is changed
+  /// populates the flame renderer's device list when the platform is changed
   void populateDeviceList();
 
-private:
+  /// picks up the latest snapshot from the evolution thread and shows it
+  void refreshView();
 
-  /// removes a directory, recursively
-  static bool removeDir(const QString &dirName);
+  /// called once the evolution thread has finished writing its logs
+  void evolutionFinished();
 
-  /// re-renders the current candidate, to show progress
-  void updateCandidateView();
+private:
 
-  /// updates all progress variables on the main dialog, and triggers an update of the candidate view
-  void updateDialog( int iterations, quint64 acceptCount, int improvements, int age, int culture, int maxCultures, int maxIterations, float iterationsPerSec );
-  
-  /// calculates the fitness for a scene, and stores the fitness value within the scene
-  static void calculateFitnessForScene( const AbstractFitness *fitness, AbstractScene *scene );
+  /// re-renders the current candidate, to show progress
+  void updateCandidateView( const EvolutionSnapshot &snapshot );
 
   Ui::trianglesClass ui;
 
-  QImage m_bestCandidate;
-  QImage m_currentCandidate;
   QImage m_target;
-  QImage m_targetRender;
 
   QString m_imageFilename;
 
-  bool m_running;
-  float m_bestFitness;
-  float m_currentFitness;
+  /// the engine for the current run, which executes on a worker thread and
+  /// hands progress back through its snapshot slot
+  EvolutionEngine *m_engine;
+  /// refreshes the view at a fixed rate, however quickly the generations are going by
+  QTimer m_refreshTimer;
+  QFutureWatcher< void > m_evolution;
+
+  /// the platform list is filled in the first time flames are picked, so opencl is only probed if it's wanted
+  bool m_platformsListed;
 
-  EmberCLns::OpenCLWrapper m_oclWrapper;
+  /// serves the progress of each run if TRIANGLES_METRICS names a port or socket
+  MetricsServer m_metrics;
+  bool m_servingMetrics;
 
 };
 
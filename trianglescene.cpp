@@ -41,6 +41,15 @@ void TriangleScene::randomise()
   }
 }
 
+quint64 TriangleScene::hash() const
+{
+  // the z-order matters, so the triangles are mixed in the order they're drawn
+  quint64 h = combineHash( combineHash( 0, m_backgroundColor.rgba() ), ( quint64( quint32( m_width ) ) << 32 ) | quint32( m_height ) );
+  for( int i = 0; i < m_polys.size(); ++ i )
+    h = m_polys[i]->hash( h );
+  return h ? h : 1;
+}
+
 void TriangleScene::mutateOnce()
 {
   // loop until mutationStrenth says we should stop
@@ -74,6 +83,26 @@ bool TriangleScene::renderTo( QImage &image )
   return true;
 }
 
+bool TriangleScene::renderBandTo( QImage &band, int top )
+{
+  QPainter painter( &band );
+  painter.translate( 0, -top );
+  painter.fillRect( 0, 0, m_width, m_height, m_backgroundColor );
+  drawTo( painter );
+
+  return true;
+}
+
+bool TriangleScene::renderScaledTo( QImage &image )
+{
+  QPainter painter( &image );
+  painter.scale( qreal( image.width() ) / m_width, qreal( image.height() ) / m_height );
+  painter.fillRect( 0, 0, m_width, m_height, m_backgroundColor );
+  drawTo( painter );
+
+  return true;
+}
+
 void TriangleScene::drawTo( QPicture &picture )
 {
   QPainter painter( &picture );
@@ -28,11 +28,17 @@ public:
 
   // rendering methods
   virtual bool renderTo( QImage &image );
+  /// polygons are drawn without antialiasing on whole pixels, so shifting the painter up by whole
+  /// rows gives exactly the same pixels
+  virtual bool renderBandTo( QImage &band, int top );
+  virtual bool rendersBands() const { return true; }
+  virtual bool renderScaledTo( QImage &image );
   void drawTo( QPicture &image );
   void drawTo( QPainter &image );
   virtual void saveToFile( const QString &fn );
 
   virtual void randomise();
+  virtual quint64 hash() const;
 
   virtual AbstractScene *clone() const;
 